@@ -0,0 +1,190 @@
+//Offline ride analysis: computes the forces felt along one or more tracks
+//and writes them out for plotting, without opening a window
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "forceprofile.h"
+#include "frametable.h"
+#include "track.h"
+#include "velocityprofile.h"
+
+using namespace std;
+
+//Bumped whenever the layout of ForceSample or the file header changes
+const unsigned int FORCE_FILE_MAGIC = 0x46434f43;   //"COCF"
+const unsigned int FORCE_FILE_VERSION = 1;
+
+struct TrackResult {
+  string name;
+  vector<ForceSample> samples;
+  string error;
+};
+
+static void analyzeTrack(TrackResult* result)
+{
+  try
+  {
+    vector<vec3> points;
+    loadControlPoints(&points, result->name, false);
+    subdivideCurve(&points, CURVE_SUBDIVISIONS);
+    if (points.size() < 2)
+      throw runtime_error("track has no points");
+
+    VelocityProfile profile(points, loadTrackSegments(result->name, points));
+    FrameTable frames(points);
+    computeForceProfile(points, profile, frames, &result->samples);
+  } catch (const exception& e)
+  {
+    result->error = e.what();
+  }
+}
+
+//Header, then for every track: name length, name, sample count, samples
+static bool writeBinary(const string& file, const vector<TrackResult>& results)
+{
+  FILE* f = fopen(file.c_str(), "wb");
+  if (!f)
+    return false;
+
+  unsigned int header[4] = { FORCE_FILE_MAGIC, FORCE_FILE_VERSION,
+                             (unsigned int)sizeof(ForceSample), (unsigned int)results.size() };
+  fwrite(header, sizeof(header), 1, f);
+  for (size_t t = 0; t < results.size(); t++)
+  {
+    unsigned int nameLength = results[t].name.size();
+    unsigned int count = results[t].samples.size();
+    fwrite(&nameLength, sizeof(nameLength), 1, f);
+    fwrite(results[t].name.data(), 1, nameLength, f);
+    fwrite(&count, sizeof(count), 1, f);
+    if (count > 0)
+      fwrite(&results[t].samples[0], sizeof(ForceSample), count, f);
+  }
+  return fclose(f) == 0;
+}
+
+static bool writeCSV(const string& file, const vector<TrackResult>& results)
+{
+  FILE* f = fopen(file.c_str(), "w");
+  if (!f)
+    return false;
+
+  fprintf(f, "track,s,v,g_vertical,g_lateral,g_longitudinal,jerk,bank_deg\n");
+  for (size_t t = 0; t < results.size(); t++)
+  {
+    for (size_t k = 0; k < results[t].samples.size(); k++)
+    {
+      const ForceSample& p = results[t].samples[k];
+      fprintf(f, "%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f\n", results[t].name.c_str(),
+              p.s, p.velocity, p.gVertical, p.gLateral, p.gLongitudinal, p.jerk, p.bank);
+    }
+  }
+  return fclose(f) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int numThreads = 0;
+  string prefix = "forces";
+  vector<TrackResult> results;
+
+  for (int a = 1; a < argc; a++)
+  {
+    string arg = argv[a];
+    if (arg == "--threads" && a + 1 < argc)
+      numThreads = atoi(argv[++a]);
+    else if (arg == "--out" && a + 1 < argc)
+      prefix = argv[++a];
+    else if (arg.size() > 1 && arg[0] == '-')
+    {
+      printf("Unknown argument %s \n", arg.c_str());
+      return -1;
+    }
+    else
+    {
+      results.push_back(TrackResult());
+      results.back().name = arg;
+    }
+  }
+
+  if (results.empty())
+  {
+    printf("usage: %s [--threads N] [--out prefix] track.con ... \n", argv[0]);
+    return -1;
+  }
+
+  if (numThreads <= 0)
+    numThreads = std::max(1u, thread::hardware_concurrency());
+  numThreads = std::min(numThreads, (int)results.size());
+
+  typedef chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+
+  //Tracks differ a lot in length, so threads take the next one as they finish
+  atomic<int> next(0);
+  vector<thread> workers;
+  for (int t = 0; t < numThreads; t++)
+  {
+    workers.push_back(thread([&results, &next]() {
+      for (int k = next++; k < (int)results.size(); k = next++)
+      {
+        analyzeTrack(&results[k]);
+      }
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++)
+  {
+    workers[t].join();
+  }
+
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+  int failed = 0;
+  long long total = 0;
+  for (size_t t = 0; t < results.size(); t++)
+  {
+    const TrackResult& r = results[t];
+    if (!r.error.empty())
+    {
+      printf("%s: ERROR %s \n", r.name.c_str(), r.error.c_str());
+      failed++;
+      continue;
+    }
+
+    float minVertical = 0.f, maxVertical = 0.f, maxLateral = 0.f;
+    float maxLongitudinal = 0.f, maxJerk = 0.f, maxBank = 0.f;
+    for (size_t k = 0; k < r.samples.size(); k++)
+    {
+      const ForceSample& p = r.samples[k];
+      minVertical = (k == 0) ? p.gVertical : std::min(minVertical, p.gVertical);
+      maxVertical = (k == 0) ? p.gVertical : std::max(maxVertical, p.gVertical);
+      maxLateral = std::max(maxLateral, fabs(p.gLateral));
+      maxLongitudinal = std::max(maxLongitudinal, fabs(p.gLongitudinal));
+      maxJerk = std::max(maxJerk, p.jerk);
+      maxBank = std::max(maxBank, fabs(p.bank));
+    }
+    total += r.samples.size();
+
+    printf("%s: %d samples, vertical %.2f..%.2f g, lateral %.2f g, longitudinal %.2f g, "
+           "jerk %.1f g/s, bank %.1f deg \n", r.name.c_str(), (int)r.samples.size(),
+           minVertical, maxVertical, maxLateral, maxLongitudinal, maxJerk, maxBank);
+  }
+
+  if (!writeBinary(prefix + ".bin", results) || !writeCSV(prefix + ".csv", results))
+  {
+    printf("ERROR: could not write %s.bin / %s.csv \n", prefix.c_str(), prefix.c_str());
+    return -1;
+  }
+
+  printf("%lld samples from %d tracks on %d threads in %.3f ms, wrote %s.bin and %s.csv \n",
+         total, (int)results.size() - failed, numThreads, seconds * 1000.0,
+         prefix.c_str(), prefix.c_str());
+  return failed ? 1 : 0;
+}
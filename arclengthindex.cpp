@@ -0,0 +1,45 @@
+#include "arclengthindex.h"
+
+#include <algorithm>
+#include <cmath>
+
+ArcLengthIndex::ArcLengthIndex(const std::vector<vec3>& points):
+  totalLength(0.f)
+{
+  int size = points.size();
+
+  for (int k = 0; k < size; k++)
+  {
+    arcLength.push_back(totalLength);
+    totalLength += length(points[(k + 1) % size] - points[k]);
+  }
+
+  bucketLength = totalLength / size;
+  for (int b = 0, k = 0; b < size; b++)
+  {
+    while (k + 1 < size && arcLength[k + 1] <= b * bucketLength)
+    {
+      k++;
+    }
+    bucket.push_back(k);
+  }
+}
+
+int ArcLengthIndex::sampleAt(float s, float* t) const
+{
+  if (s < 0.f || s >= totalLength)
+  {
+    s -= floor(s / totalLength) * totalLength;
+  }
+
+  int size = arcLength.size();
+  int k = bucket[std::min(std::max((int)(s / bucketLength), 0), size - 1)];
+  while (k + 1 < size && arcLength[k + 1] <= s)
+  {
+    k++;
+  }
+
+  float end = (k + 1 < size) ? arcLength[k + 1] : totalLength;
+  *t = (end > arcLength[k]) ? (s - arcLength[k]) / (end - arcLength[k]) : 0.f;
+  return k;
+}
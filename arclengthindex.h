@@ -0,0 +1,35 @@
+#ifndef ARCLENGTHINDEX_H
+#define ARCLENGTHINDEX_H
+
+#include "glm/glm.hpp"
+#include <vector>
+
+using namespace glm;
+
+//Arc length at every point of a closed curve, with a uniform bucket index
+//so that finding the point at a given arc length is constant time
+class ArcLengthIndex {
+public:
+  ArcLengthIndex(): totalLength(0.f), bucketLength(0.f) {}
+  ArcLengthIndex(const std::vector<vec3>& points);
+
+  //Finds the point at or before s and how far (0..1) s is towards the
+  //next one. s is wrapped onto the curve, so it can keep growing lap
+  //after lap.
+  int sampleAt(float s, float* t) const;
+
+  int size() const { return arcLength.size(); }
+  float trackLength() const { return totalLength; }
+  float sampleArcLength(int k) const { return arcLength[k % arcLength.size()]; }
+
+private:
+  std::vector<float> arcLength;
+  float totalLength;
+
+  //bucket[b] is the last point at or before arc length b * bucketLength,
+  //so sampleAt only has to step forward a point or two
+  std::vector<int> bucket;
+  float bucketLength;
+};
+
+#endif
@@ -1,11 +1,11 @@
 #version 430 core
 
-uniform mat4 modelviewMatrix;
-uniform mat4 perspectiveMatrix;
+layout(std140) uniform FrameBlock { mat4 viewProjectionMatrix; };
+layout(std140) uniform ObjectBlock { mat4 modelMatrix; };
 
 uniform vec3 beadPosition;
 
 void main(void)
 {
-    gl_Position = perspectiveMatrix * modelviewMatrix * vec4(beadPosition, 1.0);
+    gl_Position = viewProjectionMatrix * modelMatrix * vec4(beadPosition, 1.0);
 }
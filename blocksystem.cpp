@@ -0,0 +1,132 @@
+#include "blocksystem.h"
+
+#include <cmath>
+
+int BlockSystem::addTrack(const VelocityProfile& profile, int numBlocks)
+{
+  TrackBlocks t;
+  t.profile = &profile;
+  t.length = profile.trackLength();
+  t.blocks = numBlocks;
+  t.blockLength = t.length / numBlocks;
+  t.firstBlock = occupant.size();
+
+  tracks.push_back(t);
+  occupant.resize(occupant.size() + numBlocks, -1);
+  return tracks.size() - 1;
+}
+
+int BlockSystem::blockAt(const TrackBlocks& t, float s) const
+{
+  s -= floor(s / t.length) * t.length;
+  int b = (int)(s / t.blockLength);
+  return (b < t.blocks) ? b : t.blocks - 1;
+}
+
+float BlockSystem::blockEnd(const TrackBlocks& t, int b) const
+{
+  //(b + 1) * blockLength can round past the end of the track
+  return (b + 1 < t.blocks) ? (b + 1) * t.blockLength : t.length;
+}
+
+int BlockSystem::addTrain(int trackIndex, float s, float trainLength)
+{
+  const TrackBlocks& t = tracks.at(trackIndex);
+  s -= floor(s / t.length) * t.length;
+
+  int head = blockAt(t, s);
+  int tail = blockAt(t, s - trainLength);
+  int id = front.size();
+
+  //walk back from the front block to the tail block
+  for (int b = head; ; b = (b + t.blocks - 1) % t.blocks)
+  {
+    if (occupant[t.firstBlock + b] != -1)
+      return -1;
+    if (b == tail)
+      break;
+  }
+  for (int b = head; ; b = (b + t.blocks - 1) % t.blocks)
+  {
+    occupant[t.firstBlock + b] = id;
+    if (b == tail)
+      break;
+  }
+
+  front.push_back(s);
+  length.push_back(trainLength);
+  track.push_back(trackIndex);
+  frontBlock.push_back(head);
+  tailBlock.push_back(tail);
+  held.push_back(0);
+  travelled.push_back(0.0);
+  return id;
+}
+
+void BlockSystem::step(double dt)
+{
+  int count = front.size();
+  for (int i = 0; i < count; i++)
+  {
+    const TrackBlocks& t = tracks[track[i]];
+    float s = front[i];
+    float next = s + t.profile->velocityAt(s) * dt;
+
+    //Crossing into the next block needs it to be free. Steps are much
+    //shorter than a block, but a long step may cross more than one.
+    //Once the front reaches block 0 the boundaries are on the next lap.
+    //Nothing is claimed until every block the step crosses is free.
+    bool wait = false;
+    float lap = 0.f;
+    int reached = frontBlock[i];
+    float boundary = blockEnd(t, reached);
+    while (next >= boundary)
+    {
+      int ahead = (reached + 1) % t.blocks;
+      int owner = occupant[t.firstBlock + ahead];
+      if (owner != -1 && owner != i)
+      {
+        wait = true;
+        break;
+      }
+      reached = ahead;
+      if (ahead == 0)
+        lap += t.length;
+      boundary = lap + blockEnd(t, ahead);
+    }
+
+    if (wait)
+    {
+      //stays put on the step before the boundary
+      if (!held[i])
+        holdCount++;
+      held[i] = 1;
+      heldTime += dt;
+      continue;
+    }
+    held[i] = 0;
+    while (frontBlock[i] != reached)
+    {
+      frontBlock[i] = (frontBlock[i] + 1) % t.blocks;
+      occupant[t.firstBlock + frontBlock[i]] = i;
+    }
+
+    travelled[i] += next - s;
+    if (next >= t.length)
+      next -= t.length;
+    front[i] = next;
+
+    //Give back the blocks the tail has left
+    int tail = blockAt(t, next - length[i]);
+    while (tailBlock[i] != tail && tailBlock[i] != frontBlock[i])
+    {
+      occupant[t.firstBlock + tailBlock[i]] = -1;
+      tailBlock[i] = (tailBlock[i] + 1) % t.blocks;
+    }
+  }
+}
+
+int BlockSystem::laps(int train) const
+{
+  return (int)(travelled[train] / tracks[track[train]].length);
+}
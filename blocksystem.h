@@ -0,0 +1,72 @@
+#ifndef BLOCKSYSTEM_H
+#define BLOCKSYSTEM_H
+
+#include <vector>
+
+#include "velocityprofile.h"
+
+//Many trains on many tracks, kept apart by block sections. Every track is
+//cut into equal blocks and a block holds at most one train: a train whose
+//front reaches the next block waits at the boundary until that block is
+//free, and gives a block back once its tail has left it. A track needs at
+//least one block more than its trains cover or they all end up waiting.
+//
+//Train state is kept in parallel arrays indexed by train so a tick is one
+//pass over contiguous memory.
+class BlockSystem {
+public:
+  //Adds a track split into numBlocks blocks and returns its index.
+  //The profile has to outlive the BlockSystem and can be shared by tracks.
+  int addTrack(const VelocityProfile& profile, int numBlocks);
+
+  //Puts a train of the given length with its front at arc length s.
+  //Returns its index, or -1 if any block it covers is already taken.
+  int addTrain(int track, float s, float trainLength);
+
+  //Advances every train by one fixed simulation step of dt seconds
+  void step(double dt);
+
+  int numTracks() const { return tracks.size(); }
+  int numTrains() const { return front.size(); }
+  int numBlocks() const { return occupant.size(); }
+
+  //Arc length of a train's front, in [0, track length)
+  float arcLength(int train) const { return front[train]; }
+  int trackOf(int train) const { return track[train]; }
+  bool isHeld(int train) const { return held[train] != 0; }
+  int laps(int train) const;
+
+  //Number of times a train was stopped at a block boundary, and the total
+  //train-seconds spent waiting
+  long long holds() const { return holdCount; }
+  double heldSeconds() const { return heldTime; }
+
+private:
+  struct TrackBlocks {
+    const VelocityProfile* profile;
+    float length;
+    float blockLength;
+    int blocks;
+    int firstBlock;     //offset of this track's blocks in occupant
+  };
+
+  int blockAt(const TrackBlocks& t, float s) const;
+  float blockEnd(const TrackBlocks& t, int b) const;   //far boundary of block b
+
+  std::vector<TrackBlocks> tracks;
+  std::vector<int> occupant;          //train in each block, -1 when free
+
+  //per train
+  std::vector<float> front;
+  std::vector<float> length;
+  std::vector<int> track;
+  std::vector<int> frontBlock;        //blocks from tailBlock to frontBlock are held
+  std::vector<int> tailBlock;
+  std::vector<unsigned char> held;
+  std::vector<double> travelled;
+
+  long long holdCount = 0;
+  double heldTime = 0.0;
+};
+
+#endif
@@ -0,0 +1,21 @@
+// ==========================================================================
+// Vertex program for carts drawn with the GPU computed transforms
+// ==========================================================================
+#version 430 core
+
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec3 VertexNormal;
+
+//Written by cartframes.comp, one per instance
+layout(std430, binding = 3) readonly buffer Transforms { mat4 cartTransform[]; };
+
+layout(std140) uniform FrameBlock { mat4 viewProjectionMatrix; };
+layout(std140) uniform ObjectBlock { mat4 modelMatrix; };
+
+out vec3 FragNormal;
+
+void main()
+{
+	FragNormal = VertexNormal;
+	gl_Position = viewProjectionMatrix * modelMatrix * cartTransform[gl_InstanceID] * vec4(VertexPosition, 1.0);
+}
@@ -0,0 +1,80 @@
+#include "forceprofile.h"
+
+#include <cmath>
+
+#include "track.h"
+
+//Derivatives are taken over this many points either side, which smooths
+//out the corners left by the subdivision
+const int FORCE_WINDOW = 10;
+
+const float G = 9.81f;
+
+void computeForceProfile(const std::vector<vec3>& points, const VelocityProfile& profile,
+                         const FrameTable& frames, std::vector<ForceSample>* out)
+{
+  int size = points.size();
+  float L = frames.trackLength();
+  out->resize(size);
+
+  std::vector<float> s(size);
+  for (int k = 0; k < size; k++)
+  {
+    s[k] = frames.sampleArcLength(k);
+  }
+
+  std::vector<vec3> force(size);
+  for (int k = 0; k < size; k++)
+  {
+    int prev = (k - FORCE_WINDOW + size) % size;
+    int next = (k + FORCE_WINDOW) % size;
+
+    float ds0 = s[k] - s[prev];
+    float ds1 = s[next] - s[k];
+    if (ds0 <= 0.f)
+      ds0 += L;
+    if (ds1 <= 0.f)
+      ds1 += L;
+
+    //curvature vector d2x/ds2 and the along track change in speed
+    vec3 curvature = ((points[next] - points[k]) / ds1 - (points[k] - points[prev]) / ds0)
+                     * (2.f / (ds0 + ds1));
+    float v = profile.velocityAt(s[k]);
+    float dvds = (profile.velocityAt(s[next]) - profile.velocityAt(s[prev])) / (ds0 + ds1);
+
+    quat q = frames.sampleOrientation(k);
+    mat3 R = mat3_cast(q);
+    vec3 lateral = R[0];
+    vec3 up = R[1];
+    vec3 tangent = R[2];
+
+    //acceleration along the path plus the seat holding the rider up
+    //against gravity
+    vec3 acceleration = v * dvds * tangent + v * v * curvature;
+    vec3 f = (acceleration + GRAVITY) / G;
+    force[k] = f;
+
+    ForceSample& sample = (*out)[k];
+    sample.s = s[k];
+    sample.velocity = v;
+    sample.gVertical = dot(f, up);
+    sample.gLateral = dot(f, lateral);
+    sample.gLongitudinal = dot(f, tangent);
+
+    //roll about the tangent, 0 when the cart's lateral axis is level
+    vec3 worldUp = normalize(GRAVITY);
+    sample.bank = (float)(atan2(dot(lateral, worldUp), dot(up, worldUp)) * 180.0 / 3.14159265359);
+  }
+
+  //jerk from the change in force between neighbouring points
+  for (int k = 0; k < size; k++)
+  {
+    int next = (k + 1) % size;
+    float ds = s[next] - s[k];
+    if (ds <= 0.f)
+      ds += L;
+    float v = 0.5f * ((*out)[k].velocity + (*out)[next].velocity);
+    float dt = (ds > 0.f && v > 0.f) ? ds / v : 0.f;
+    (*out)[k].jerk = (dt > 0.f) ? length(force[next] - force[k]) / dt : 0.f;
+  }
+}
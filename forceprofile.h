@@ -0,0 +1,28 @@
+#ifndef FORCEPROFILE_H
+#define FORCEPROFILE_H
+
+#include "glm/glm.hpp"
+#include <vector>
+
+#include "frametable.h"
+#include "velocityprofile.h"
+
+using namespace glm;
+
+//What the passengers feel at one point of the track. Forces are the
+//seat's push on the rider in units of g, along the cart's axes.
+struct ForceSample {
+  float s;              //arc length
+  float velocity;
+  float gVertical;      //along the cart's up vector, 1 when sitting still
+  float gLateral;       //sideways, towards the cart's binormal
+  float gLongitudinal;  //along the direction of travel
+  float jerk;           //rate of change of the force, in g per second
+  float bank;           //roll of the cart about the track, in degrees
+};
+
+//Fills out with one sample per track point
+void computeForceProfile(const std::vector<vec3>& points, const VelocityProfile& profile,
+                         const FrameTable& frames, std::vector<ForceSample>* out);
+
+#endif
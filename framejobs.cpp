@@ -0,0 +1,222 @@
+#include "framejobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "framekernel.h"
+#include "frametable.h"
+#include "replay.h"
+
+//Trains per job of the frame graph
+const int JOB_TRAINS = 64;
+
+//Frames a second runJobsHeadless draws
+const int JOB_FRAME_RATE = 60;
+
+//Radius of the sphere round a car that is tested against the view
+const float CULL_RADIUS = 0.4f;
+
+ParkFrame::ParkFrame(const PackedFrameTable& frames, const std::vector<Train>& trains, TelemetryWriter* telemetry):
+  table(frames), telemetry(telemetry), park(trains), cars(trains.empty() ? 0 : trains[0].cars()),
+  chunks((trains.size() + JOB_TRAINS - 1) / JOB_TRAINS), steps(0), dt(0.0), alpha(0.f),
+  visibleCars(0), lapCount(0), tick(0)
+{
+  int numTrains = park.size();
+  int numCars = numTrains * cars;
+  arcLengths.resize(numCars);
+  modelMatrices.resize(numCars);
+  visible.resize(numCars);
+  chunkVisible.resize(chunks);
+  chunkOffset.resize(chunks);
+  instanceMatrices.resize(std::max(numCars, 1));
+
+  JobGraph::Job physics = stepGraph.parallelFor(numTrains, JOB_TRAINS, [this](int begin, int end) {
+    for (int t = begin; t < end; t++)
+      for (int n = 0; n < steps; n++)
+        park[t].step(dt);
+  });
+  stepGraph.add([this, numTrains]() {
+    lapCount = 0;
+    for (int t = 0; t < numTrains; t++)
+      lapCount += park[t].laps();
+    tick += steps;
+    if (this->telemetry && this->telemetry->isOpen() && numTrains > 0)
+      this->telemetry->push(tick, &park[0], numTrains);
+  }, { physics });
+
+  JobGraph::Job cull = buildGraph.parallelFor(chunks, 1, [this, numTrains](int begin, int end) {
+    for (int c = begin; c < end; c++)
+    {
+      int firstTrain = c * JOB_TRAINS, lastTrain = std::min((c + 1) * JOB_TRAINS, numTrains);
+      for (int t = firstTrain; t < lastTrain; t++)
+        park[t].carArcLengths(alpha, &arcLengths[t * cars]);
+      int first = firstTrain * cars, last = lastTrain * cars;
+      computeCartFrames(table, &arcLengths[first], last - first, &modelMatrices[first]);
+      int count = 0;
+      for (int a = first; a < last; a++)
+      {
+        vec4 position = modelMatrices[a][3];
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+          inside = dot(planes[p], position) >= -CULL_RADIUS;
+        visible[a] = inside;
+        count += inside;
+      }
+      chunkVisible[c] = count;
+    }
+  });
+  JobGraph::Job offsets = buildGraph.add([this]() {
+    visibleCars = 0;
+    for (int c = 0; c < chunks; c++)
+    {
+      chunkOffset[c] = visibleCars;
+      visibleCars += chunkVisible[c];
+    }
+  }, { cull });
+  buildGraph.parallelFor(chunks, 1, [this, numTrains](int begin, int end) {
+    for (int c = begin; c < end; c++)
+    {
+      int out = chunkOffset[c];
+      int last = std::min((c + 1) * JOB_TRAINS, numTrains) * cars;
+      for (int a = c * JOB_TRAINS * cars; a < last; a++)
+        if (visible[a])
+          instanceMatrices[out++] = modelMatrices[a];
+    }
+  }, { offsets });
+}
+
+void ParkFrame::step(JobSystem& jobs, int numSteps, double stepDt)
+{
+  steps = numSteps;
+  dt = stepDt;
+  jobs.run(stepGraph);
+}
+
+void ParkFrame::build(JobSystem& jobs, float frameAlpha, const mat4& viewProjection)
+{
+  //Frustum planes from the rows of the clip matrix
+  mat4 rows = transpose(viewProjection);
+  vec4 clip[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                   rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+  for (int p = 0; p < 6; p++)
+  {
+    planes[p] = clip[p] / length(vec3(clip[p]));
+  }
+  alpha = frameAlpha;
+  jobs.run(buildGraph);
+}
+
+mat4 ParkFrame::frontCar(float frameAlpha) const
+{
+  mat4 front(1.f);
+  if (park.empty())
+    return front;
+  std::vector<float> s(cars);
+  park[0].carArcLengths(frameAlpha, &s[0]);
+  computeCartFrames(table, &s[0], 1, &front);
+  return front;
+}
+
+int runJobsHeadless(const HeadlessOptions& options)
+{
+  if (!checkRunOptions(options, CHECK_RUN | CHECK_CARS))
+    return -1;
+
+  std::vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &points, &segments))
+    return -1;
+  VelocityProfile profile(points, segments);
+  FrameTable frameTable(points);
+  PackedFrameTable packedFrames(frameTable);
+
+  std::vector<Train> start;
+  float startArcLength = profile.sampleArcLength(segments.start());
+  for (int t = 0; t < options.trains; t++)
+  {
+    start.push_back(Train(profile, startArcLength + t * profile.trackLength() / options.trains,
+                          options.cars, CAR_COUPLING));
+  }
+
+  TelemetryWriter telemetry;
+  if (!options.telemetry.empty() &&
+      !telemetry.open(options.telemetry, options.simRate, points, profile, frameTable))
+  {
+    printf("ERROR: unable to create %s \n", options.telemetry.c_str());
+    return -1;
+  }
+
+  //The window's starting view
+  vec3 eye(0.31649f, -0.564746f, 4.26627f);
+  mat4 view = perspective(radians(80.f), 1.f, 0.1f, 20.f) * lookAt(eye, eye + vec3(0.f, 0.f, -1.f), vec3(0.f, 1.f, 0.f));
+
+  int numTrains = options.trains;
+  int chunks = (numTrains + JOB_TRAINS - 1) / JOB_TRAINS;
+  int stepsPerFrame = std::max(1, (int)floor(options.simRate / JOB_FRAME_RATE + 0.5));
+  long long frames = (long long)(options.seconds * JOB_FRAME_RATE);
+  const double simDt = 1.0 / options.simRate;
+
+  int maxThreads = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  std::vector<int> threadCounts;
+  for (int n = 1; n < maxThreads; n *= 2)
+  {
+    threadCounts.push_back(n);
+  }
+  threadCounts.push_back(maxThreads);
+
+  printf("track:    %s (%.2f m) \n", options.track.c_str(), profile.trackLength());
+  printf("park:     %d trains of %d cars, %lld frames of %d steps at %.0f Hz, %d jobs of %d trains \n",
+         numTrains, options.cars, frames, stepsPerFrame, options.simRate, chunks, JOB_TRAINS);
+  printf("threads   ms/frame   worst ms   speedup   steals/frame   visible   checksum \n");
+
+  double baseFrame = 0.0;
+  for (size_t run = 0; run < threadCounts.size(); run++)
+  {
+    bool record = telemetry.isOpen() && run + 1 == threadCounts.size();
+    ParkFrame park(packedFrames, start, record ? &telemetry : 0);
+
+    JobSystem jobs(threadCounts[run]);
+    typedef std::chrono::steady_clock Clock;
+    double totalSeconds = 0.0, worstSeconds = 0.0;
+    uint64_t stealsBefore = jobs.jobsStolen();
+    for (long long f = 0; f < frames; f++)
+    {
+      Clock::time_point frameStart = Clock::now();
+      park.step(jobs, stepsPerFrame, simDt);
+      park.build(jobs, 1.f, view);
+      double seconds = std::chrono::duration<double>(Clock::now() - frameStart).count();
+      totalSeconds += seconds;
+      worstSeconds = std::max(worstSeconds, seconds);
+    }
+
+    uint32_t state = checksumBytes(0, 0);
+    for (int t = 0; t < numTrains; t++)
+    {
+      state = checksumBytes(&park.trains()[t].state(), sizeof(TrainState), state);
+    }
+    state = checksumBytes(park.instances(), park.visibleCount() * sizeof(mat4), state);
+
+    double perFrame = totalSeconds / std::max(frames, 1LL);
+    if (run == 0)
+      baseFrame = perFrame;
+    printf("%7d   %8.3f   %8.3f   %6.2fx   %12.1f   %7d   %08x \n", jobs.threads(), 1e3 * perFrame,
+           1e3 * worstSeconds, baseFrame / perFrame, (double)(jobs.jobsStolen() - stealsBefore) / std::max(frames, 1LL),
+           park.visibleCount(), state);
+    if (run + 1 == threadCounts.size())
+      printf("laps completed: %lld \n", park.laps());
+  }
+
+  if (telemetry.isOpen())
+  {
+    bool ok = telemetry.close();
+    printf("telemetry: %llu records to %s, %llu dropped%s \n", (unsigned long long)telemetry.written(),
+           options.telemetry.c_str(), (unsigned long long)telemetry.dropped(), ok ? "" : ", WRITE FAILED");
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef FRAMEJOBS_H
+#define FRAMEJOBS_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "headless.h"
+#include "jobsystem.h"
+#include "packedframes.h"
+#include "telemetry.h"
+#include "train.h"
+
+using namespace glm;
+
+//A park of trains on one track whose frame is built by jobs: physics,
+//then car frames and view culling with telemetry alongside, then packing
+//the visible cars into an instance buffer. Only uploading and drawing the
+//instances is left for the thread with the GL context.
+class ParkFrame {
+public:
+  //The table, and telemetry if not null, have to outlive the ParkFrame.
+  //Every train needs the same number of cars.
+  ParkFrame(const PackedFrameTable& frames, const std::vector<Train>& trains, TelemetryWriter* telemetry);
+  ParkFrame(const ParkFrame&) = delete;
+  ParkFrame& operator=(const ParkFrame&) = delete;
+
+  //Advances every train by steps fixed steps of dt seconds. Telemetry gets
+  //every train once, after the last of them.
+  void step(JobSystem& jobs, int steps, double dt);
+
+  //Every car alpha of the way into the next step, culled against the
+  //frustum of viewProjection. The visible ones end up in instances().
+  void build(JobSystem& jobs, float alpha, const mat4& viewProjection);
+
+  //Model matrix of the first train's front car, for a camera to ride on
+  mat4 frontCar(float alpha) const;
+
+  const std::vector<Train>& trains() const { return park; }
+  const mat4* instances() const { return &instanceMatrices[0]; }
+  int visibleCount() const { return visibleCars; }
+  long long laps() const { return lapCount; }
+
+private:
+  const PackedFrameTable& table;
+  TelemetryWriter* telemetry;
+  std::vector<Train> park;
+  int cars;
+  int chunks;
+
+  //What the next run of each graph does
+  int steps;
+  double dt;
+  float alpha;
+  vec4 planes[6];
+
+  std::vector<float> arcLengths;
+  std::vector<mat4> modelMatrices;
+  std::vector<unsigned char> visible;
+  std::vector<int> chunkVisible, chunkOffset;
+  std::vector<mat4> instanceMatrices;
+  int visibleCars;
+  long long lapCount;
+  uint32_t tick;
+
+  JobGraph stepGraph, buildGraph;
+};
+
+//Runs the CPU side of options.seconds of display frames for a park of
+//options.trains trains on options.track with a ParkFrame on the job
+//system. Does it with 1, 2, 4 ... threads up to options.threads and
+//prints the time per frame and speedup of each.
+int runJobsHeadless(const HeadlessOptions& options);
+
+#endif
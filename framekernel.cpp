@@ -0,0 +1,218 @@
+#include "framekernel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Gathers the two table entries either side of each lane's arc length into
+//lane-major arrays. Table is a FrameTable or PackedFrameTable and Entry
+//what it stores per orientation.
+template <class Table, class Entry>
+static void gatherLanes(const Table& table, const float* s, int lanes,
+                        Entry e0[FRAME_LANES], Entry e1[FRAME_LANES],
+                        float p[3][FRAME_LANES], float* t,
+                        Entry (Table::*entry)(int) const)
+{
+  int size = table.size();
+  for (int l = 0; l < FRAME_LANES; l++)
+  {
+    //pad a short final group with copies of its first cart
+    int k = table.sampleAt(s[l < lanes ? l : 0], &t[l]);
+    int next = (k + 1) % size;
+    vec3 pos = mix(table.samplePosition(k), table.samplePosition(next), t[l]);
+
+    e0[l] = (table.*entry)(k);
+    e1[l] = (table.*entry)(next);
+    p[0][l] = pos.x; p[1][l] = pos.y; p[2][l] = pos.z;
+  }
+}
+
+#ifdef __SSE2__
+
+//Writes four columns (x, y, z, w lanes) out as column c of four matrices
+static inline void storeColumn(__m128 x, __m128 y, __m128 z, __m128 w, int c, mat4* out, int lanes)
+{
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  __m128 cols[FRAME_LANES] = { x, y, z, w };
+  for (int l = 0; l < lanes; l++)
+  {
+    _mm_storeu_ps(&out[l][c][0], cols[l]);
+  }
+}
+
+//Loads four quaternions as x, y, z and w lanes
+static inline void loadQuats(const quat q[FRAME_LANES], __m128* x, __m128* y, __m128* z, __m128* w)
+{
+  __m128 a = _mm_loadu_ps(&q[0].x);
+  __m128 b = _mm_loadu_ps(&q[1].x);
+  __m128 c = _mm_loadu_ps(&q[2].x);
+  __m128 d = _mm_loadu_ps(&q[3].x);
+  _MM_TRANSPOSE4_PS(a, b, c, d);
+  *x = a; *y = b; *z = c; *w = d;
+}
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+//Unpacks four smallest three 10 bit quaternions (see packQuat)
+static inline void unpackQuats10(const uint32_t packed[FRAME_LANES], __m128* x, __m128* y, __m128* z, __m128* w)
+{
+  const __m128i mask = _mm_set1_epi32(1023);
+  const __m128 scale = _mm_set1_ps(2.f * 0.70710678f / 1023.f);
+  const __m128 offset = _mm_set1_ps(-0.70710678f);
+
+  __m128i words = _mm_loadu_si128((const __m128i*)packed);
+  __m128i largest = _mm_srli_epi32(words, 30);
+  __m128 a = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(words, 20), mask)), scale), offset);
+  __m128 b = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(words, 10), mask)), scale), offset);
+  __m128 c = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(words, mask)), scale), offset);
+
+  __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+  __m128 d = _mm_sqrt_ps(_mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_set1_ps(1.f), sum)));
+
+  //a, b and c are the components other than the largest, in order
+  __m128 m0 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(0)));
+  __m128 m1 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(1)));
+  __m128 m2 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(2)));
+  __m128 m3 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(3)));
+
+  *x = select(m0, d, a);
+  *y = select(m0, a, select(m1, d, b));
+  *z = select(_mm_or_ps(m0, m1), b, select(m2, d, c));
+  *w = select(m3, d, c);
+}
+
+//nlerps from quaternion a to b by tt and writes the cart frames
+static inline void buildFrames(__m128 ax, __m128 ay, __m128 az, __m128 aw,
+                               __m128 bx, __m128 by, __m128 bz, __m128 bw,
+                               __m128 tt, const float p[3][FRAME_LANES], mat4* dst, int lanes)
+{
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 two = _mm_set1_ps(2.f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 signBit = _mm_set1_ps(-0.f);
+
+  //take the short way round: flip b where it is in the other hemisphere
+  __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+                        _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+  __m128 flip = _mm_and_ps(_mm_cmplt_ps(d, zero), signBit);
+  bx = _mm_xor_ps(bx, flip); by = _mm_xor_ps(by, flip);
+  bz = _mm_xor_ps(bz, flip); bw = _mm_xor_ps(bw, flip);
+
+  //normalized lerp
+  __m128 ta = _mm_sub_ps(one, tt);
+  __m128 x = _mm_add_ps(_mm_mul_ps(ax, ta), _mm_mul_ps(bx, tt));
+  __m128 y = _mm_add_ps(_mm_mul_ps(ay, ta), _mm_mul_ps(by, tt));
+  __m128 z = _mm_add_ps(_mm_mul_ps(az, ta), _mm_mul_ps(bz, tt));
+  __m128 w = _mm_add_ps(_mm_mul_ps(aw, ta), _mm_mul_ps(bw, tt));
+  __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                                      _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+  x = _mm_div_ps(x, len); y = _mm_div_ps(y, len);
+  z = _mm_div_ps(z, len); w = _mm_div_ps(w, len);
+
+  //rotation matrix, laid out as in glm's mat3_cast
+  __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+  __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+  __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+  //column 0 is mirrored to match the cart frame layout (see frameMatrix)
+  __m128 r00 = _mm_sub_ps(_mm_mul_ps(two, _mm_add_ps(yy, zz)), one);
+  __m128 r01 = _mm_mul_ps(two, _mm_sub_ps(zero, _mm_add_ps(xy, wz)));
+  __m128 r02 = _mm_mul_ps(two, _mm_sub_ps(wy, xz));
+
+  __m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+  __m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+  __m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+
+  __m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+  __m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+  __m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+  storeColumn(r00, r01, r02, zero, 0, dst, lanes);
+  storeColumn(r10, r11, r12, zero, 1, dst, lanes);
+  storeColumn(r20, r21, r22, zero, 2, dst, lanes);
+  storeColumn(_mm_loadu_ps(p[0]), _mm_loadu_ps(p[1]), _mm_loadu_ps(p[2]), one, 3, dst, lanes);
+}
+
+void computeCartFrames(const FrameTable& table, const float* s, int count, mat4* out)
+{
+  for (int base = 0; base < count; base += FRAME_LANES)
+  {
+    int lanes = (count - base < FRAME_LANES) ? count - base : FRAME_LANES;
+
+    quat q0[FRAME_LANES], q1[FRAME_LANES];
+    float p[3][FRAME_LANES], t[FRAME_LANES];
+    gatherLanes(table, s + base, lanes, q0, q1, p, t, &FrameTable::sampleOrientation);
+
+    __m128 ax, ay, az, aw, bx, by, bz, bw;
+    loadQuats(q0, &ax, &ay, &az, &aw);
+    loadQuats(q1, &bx, &by, &bz, &bw);
+    buildFrames(ax, ay, az, aw, bx, by, bz, bw, _mm_loadu_ps(t), p, out + base, lanes);
+  }
+}
+
+void computeCartFrames(const PackedFrameTable& table, const float* s, int count, mat4* out)
+{
+  for (int base = 0; base < count; base += FRAME_LANES)
+  {
+    int lanes = (count - base < FRAME_LANES) ? count - base : FRAME_LANES;
+
+    uint32_t q0[FRAME_LANES], q1[FRAME_LANES];
+    float p[3][FRAME_LANES], t[FRAME_LANES];
+    gatherLanes(table, s + base, lanes, q0, q1, p, t, &PackedFrameTable::packedOrientation);
+
+    __m128 ax, ay, az, aw, bx, by, bz, bw;
+    unpackQuats10(q0, &ax, &ay, &az, &aw);
+    unpackQuats10(q1, &bx, &by, &bz, &bw);
+    buildFrames(ax, ay, az, aw, bx, by, bz, bw, _mm_loadu_ps(t), p, out + base, lanes);
+  }
+}
+
+#else
+
+//nlerps between the gathered orientations and writes the cart frames
+static void buildFrames(const quat q0[FRAME_LANES], const quat q1[FRAME_LANES],
+                        const float p[3][FRAME_LANES], const float* t, mat4* dst, int lanes)
+{
+  for (int l = 0; l < lanes; l++)
+  {
+    quat a = q0[l];
+    quat b = q1[l];
+    if (dot(a, b) < 0.f)
+    {
+      b = -b;
+    }
+    quat q = normalize(a * (1.f - t[l]) + b * t[l]);
+    dst[l] = frameMatrix(q, vec3(p[0][l], p[1][l], p[2][l]));
+  }
+}
+
+void computeCartFrames(const FrameTable& table, const float* s, int count, mat4* out)
+{
+  for (int base = 0; base < count; base += FRAME_LANES)
+  {
+    int lanes = (count - base < FRAME_LANES) ? count - base : FRAME_LANES;
+
+    quat q0[FRAME_LANES], q1[FRAME_LANES];
+    float p[3][FRAME_LANES], t[FRAME_LANES];
+    gatherLanes(table, s + base, lanes, q0, q1, p, t, &FrameTable::sampleOrientation);
+    buildFrames(q0, q1, p, t, out + base, lanes);
+  }
+}
+
+void computeCartFrames(const PackedFrameTable& table, const float* s, int count, mat4* out)
+{
+  for (int base = 0; base < count; base += FRAME_LANES)
+  {
+    int lanes = (count - base < FRAME_LANES) ? count - base : FRAME_LANES;
+
+    quat q0[FRAME_LANES], q1[FRAME_LANES];
+    float p[3][FRAME_LANES], t[FRAME_LANES];
+    gatherLanes(table, s + base, lanes, q0, q1, p, t, &PackedFrameTable::sampleOrientation);
+    buildFrames(q0, q1, p, t, out + base, lanes);
+  }
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef FRAMEKERNEL_H
+#define FRAMEKERNEL_H
+
+#include "glm/glm.hpp"
+
+#include "frametable.h"
+#include "packedframes.h"
+
+using namespace glm;
+
+//Carts handled together by one pass of the SIMD kernel
+const int FRAME_LANES = 4;
+
+//Writes the model matrix of every cart into out, given the carts' arc
+//lengths in s (one float per cart, structure of arrays). Works through
+//the carts FRAME_LANES at a time with SSE, falling back to plain C++
+//where SSE is not available. Orientation is a normalized lerp between
+//the neighbouring table entries, which are only a few degrees apart, so
+//it agrees with FrameTable::modelMatrix's slerp to well under 1e-4.
+void computeCartFrames(const FrameTable& table, const float* s, int count, mat4* out);
+
+//The same from 10 bit packed orientations, unpacked four at a time
+void computeCartFrames(const PackedFrameTable& table, const float* s, int count, mat4* out);
+
+#endif
@@ -0,0 +1,140 @@
+#include "frametable.h"
+
+#include <cmath>
+
+#include "glm/gtc/constants.hpp"
+
+#include "track.h"
+
+//Curvature is measured over this many points either side
+const int CURVATURE_WINDOW = 10;
+
+//Below this the gravity plus curvature vector is too close to the
+//tangent to give a banking direction
+const float MIN_BANK_LENGTH = 1e-3f;
+
+//The bank fades out as the gravity plus curvature vector shrinks below
+//this (m/s^2, about 0.1 g), leaving the rotation minimizing frame
+const float BANK_FADE_LENGTH = 1.f;
+
+FrameTable::FrameTable(const std::vector<vec3>& points):
+  index(points), position(points)
+{
+  int size = points.size();
+
+  //Tangents from the neighbouring points. The closing point repeats the
+  //first, so step over zero length segments.
+  std::vector<vec3> tangent(size);
+  for (int k = 0; k < size; k++)
+  {
+    vec3 d(0.f);
+    for (int w = 1; w < size && dot(d, d) == 0.f; w++)
+    {
+      d = points[(k + w) % size] - points[(k - w + size) % size];
+    }
+    tangent[k] = normalize(d);
+  }
+
+  //The direction the passengers should feel as up at each point
+  std::vector<vec3> bankedUp(size);
+  for (int k = 0; k < size; k++)
+  {
+    vec3 prev = points[(k - CURVATURE_WINDOW + size) % size];
+    vec3 next = points[(k + CURVATURE_WINDOW) % size];
+    vec3 cur = points[k];
+
+    double x = calculate_x(prev, cur, next);
+    double c = calculate_c(prev, next);
+
+    vec3 acc_perpendicular(0.f);
+    if (x > 0.0)
+    {
+      double r = (pow(x, 2) + pow(c, 2))/(2 * x);
+      acc_perpendicular = (float)(1.0 / r) * normalize(next - 2.0f * cur + prev);
+    }
+    vec3 normal = acc_perpendicular + GRAVITY;
+    bankedUp[k] = normal - dot(normal, tangent[k]) * tangent[k];
+  }
+
+  //Start the rotation minimizing frame from the banked up vector (or any
+  //perpendicular if that is degenerate) and carry it along the curve by
+  //double reflection
+  vec3 up = bankedUp[0];
+  if (length(up) < MIN_BANK_LENGTH)
+  {
+    up = cross(tangent[0], (abs(tangent[0].x) < 0.9f) ? vec3(1, 0, 0) : vec3(0, 1, 0));
+  }
+  up = normalize(up);
+
+  orientation.resize(size);
+  float previousBank = 0.f;
+  for (int k = 0; k < size; k++)
+  {
+    if (k > 0)
+    {
+      vec3 v1 = points[k] - points[k - 1];
+      float c1 = dot(v1, v1);
+      vec3 rL = up;
+      vec3 tL = tangent[k - 1];
+      if (c1 > 0.f)
+      {
+        rL = up - (2.f / c1) * dot(v1, up) * v1;
+        tL = tL - (2.f / c1) * dot(v1, tL) * v1;
+      }
+      vec3 v2 = tangent[k] - tL;
+      float c2 = dot(v2, v2);
+      up = (c2 > 0.f) ? rL - (2.f / c2) * dot(v2, rL) * v2 : rL;
+      up = normalize(up - dot(up, tangent[k]) * tangent[k]);
+    }
+
+    //Bank about the tangent by the angle from the rotation minimizing up
+    //vector to the gravity plus curvature direction, less of it the
+    //weaker that direction is, so the frame never switches between the two
+    vec3 T = tangent[k];
+    vec3 side = cross(T, up);
+    float bank = atan2(dot(bankedUp[k], side), dot(bankedUp[k], up));
+    bank += two_pi<float>() * floor((previousBank - bank) / two_pi<float>() + 0.5f);
+    previousBank = bank;
+    bank *= clamp(length(bankedUp[k]) / BANK_FADE_LENGTH, 0.f, 1.f);
+    vec3 cartUp = cos(bank) * up + sin(bank) * side;
+
+    vec3 X = cross(cartUp, T);
+    quat q = quat_cast(mat3(X, cartUp, T));
+
+    //Keep neighbouring quaternions in the same hemisphere so the slerp
+    //between them takes the short way round
+    if (k > 0 && dot(q, orientation[k - 1]) < 0.f)
+    {
+      q = -q;
+    }
+    orientation[k] = q;
+  }
+}
+
+vec3 FrameTable::positionAt(float s) const
+{
+  float t;
+  int k = sampleAt(s, &t);
+  return mix(position[k], position[(k + 1) % position.size()], t);
+}
+
+quat FrameTable::orientationAt(float s) const
+{
+  float t;
+  int k = sampleAt(s, &t);
+  return slerp(orientation[k], orientation[(k + 1) % orientation.size()], t);
+}
+
+mat4 FrameTable::modelMatrix(float s) const
+{
+  float t;
+  int k = sampleAt(s, &t);
+  int next = (k + 1) % position.size();
+  return frameMatrix(slerp(orientation[k], orientation[next], t), mix(position[k], position[next], t));
+}
+
+mat4 frameMatrix(quat q, vec3 position)
+{
+  mat3 R = mat3_cast(q);
+  return mat4(vec4(-R[0], 0), vec4(R[1], 0), vec4(R[2], 0), vec4(position, 1));
+}
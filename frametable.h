@@ -0,0 +1,50 @@
+#ifndef FRAMETABLE_H
+#define FRAMETABLE_H
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <vector>
+
+#include "arclengthindex.h"
+
+using namespace glm;
+
+//Cart orientation at every curve point, computed once at load.
+//The frame is rotation minimizing (double reflection), then banked about
+//the tangent so the cart's up vector follows gravity plus curvature and
+//the passengers are pushed into their seats. Unlike the finite difference
+//Frenet frame it never flips at inflection points, and where gravity plus
+//curvature gives no usable up vector (straight vertical track) the frame
+//just carries on smoothly.
+class FrameTable {
+public:
+  FrameTable(const std::vector<vec3>& points);
+
+  //s is wrapped onto the track
+  vec3 positionAt(float s) const;
+  quat orientationAt(float s) const;
+
+  //Columns are binormal, up, tangent, position
+  mat4 modelMatrix(float s) const;
+
+  int size() const { return index.size(); }
+  float trackLength() const { return index.trackLength(); }
+  float sampleArcLength(int k) const { return index.sampleArcLength(k); }
+  vec3 samplePosition(int k) const { return position[k]; }
+  quat sampleOrientation(int k) const { return orientation[k]; }
+  const ArcLengthIndex& arcLengths() const { return index; }
+
+  int sampleAt(float s, float* t) const { return index.sampleAt(s, t); }
+
+private:
+  ArcLengthIndex index;
+  std::vector<vec3> position;
+  std::vector<quat> orientation;
+};
+
+//Cart model matrices have a mirrored x axis (binormal = tangent x up), as
+//the original Frenet frame did. The table stores the proper rotation
+//(up x tangent, up, tangent) and this builds the cart matrix from it.
+mat4 frameMatrix(quat q, vec3 position);
+
+#endif
@@ -0,0 +1,93 @@
+#include "gpuframes.h"
+
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+typedef void (APIENTRYP PFNDISPATCHCOMPUTE)(GLuint x, GLuint y, GLuint z);
+typedef void (APIENTRYP PFNMEMORYBARRIER)(GLbitfield barriers);
+
+static PFNDISPATCHCOMPUTE dispatchCompute = 0;
+static PFNMEMORYBARRIER memoryBarrier = 0;
+
+//Must match local_size_x in cartframes.comp
+const int CART_GROUP_SIZE = 64;
+
+bool GpuCartFrames::loadEntryPoints()
+{
+  dispatchCompute = (PFNDISPATCHCOMPUTE)glfwGetProcAddress("glDispatchCompute");
+  memoryBarrier = (PFNMEMORYBARRIER)glfwGetProcAddress("glMemoryBarrier");
+  return dispatchCompute && memoryBarrier;
+}
+
+GpuCartFrames::GpuCartFrames(const FrameTable& frames, const ShaderProgram& computeProgram):
+  program(computeProgram), trackLength(frames.trackLength()), cartCount(0), capacity(0)
+{
+  int size = frames.size();
+  std::vector<float> arcLengths(size);
+  std::vector<vec4> table(2 * size);
+  for (int k = 0; k < size; k++)
+  {
+    arcLengths[k] = frames.sampleArcLength(k);
+    quat q = frames.sampleOrientation(k);
+    table[2 * k] = vec4(frames.samplePosition(k), 0.f);
+    table[2 * k + 1] = vec4(q.x, q.y, q.z, q.w);
+  }
+
+  glGenBuffers(COUNT, buffer);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer[ARC_LENGTHS]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * size, &arcLengths[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer[FRAMES]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec4) * table.size(), &table[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  trackLengthLocation = program.location("trackLength");
+  cartCountLocation = program.location("cartCount");
+}
+
+GpuCartFrames::~GpuCartFrames()
+{
+  glDeleteBuffers(COUNT, buffer);
+}
+
+void GpuCartFrames::update(const float* s, int count)
+{
+  cartCount = count;
+  if (count <= 0)
+    return;
+
+  //Only reallocate when the number of carts grows
+  if (count > capacity)
+  {
+    capacity = count;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer[CARTS]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * capacity, 0, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer[TRANSFORMS]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(mat4) * capacity, 0, GL_DYNAMIC_COPY);
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer[CARTS]);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * count, s);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  for (int b = 0; b < COUNT; b++)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, buffer[b]);
+  }
+
+  program.use();
+  glUniform1f(trackLengthLocation, trackLength);
+  glUniform1i(cartCountLocation, count);
+  dispatchCompute((count + CART_GROUP_SIZE - 1) / CART_GROUP_SIZE, 1, 1);
+
+  //cart.vert reads the transforms as a storage buffer too
+  memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCartFrames::readTransforms(mat4* out, int count) const
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer[TRANSFORMS]);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(mat4) * count, out);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,57 @@
+#ifndef GPUFRAMES_H
+#define GPUFRAMES_H
+
+#include "glm/glm.hpp"
+
+#include "glad/glad.h"
+
+#include "frametable.h"
+#include "shaderprogram.h"
+
+using namespace glm;
+
+//The bundled glad loader stops at OpenGL 4.0, so the compute and storage
+//buffer pieces of 4.3 that are needed here are declared by hand
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER               0x91B9
+#define GL_SHADER_STORAGE_BUFFER        0x90D2
+#define GL_SHADER_STORAGE_BARRIER_BIT   0x00002000
+#endif
+
+//Builds the cart model matrices with a compute shader instead of on the
+//CPU. The arc length and frame tables are uploaded once, after that only
+//each cart's arc length goes up per frame and the matrices stay on the GPU
+//for cart.vert to read by instance. Needs an OpenGL 4.3 context.
+class GpuCartFrames {
+public:
+  //Loads glDispatchCompute and glMemoryBarrier, returns false if
+  //the context doesn't have them
+  static bool loadEntryPoints();
+
+  //computeProgram is cartframes.comp, linked
+  GpuCartFrames(const FrameTable& frames, const ShaderProgram& computeProgram);
+  ~GpuCartFrames();
+  GpuCartFrames(const GpuCartFrames&) = delete;
+  GpuCartFrames& operator=(const GpuCartFrames&) = delete;
+
+  //Uploads the arc lengths of count carts and runs the compute pass
+  void update(const float* s, int count);
+
+  //Copies the first count transforms back, only for checking against the CPU
+  void readTransforms(mat4* out, int count) const;
+
+  int count() const { return cartCount; }
+
+private:
+  enum { ARC_LENGTHS = 0, FRAMES, CARTS, TRANSFORMS, COUNT };
+
+  ShaderProgram program;
+  GLuint buffer[COUNT];
+  GLint trackLengthLocation;
+  GLint cartCountLocation;
+  float trackLength;
+  int cartCount;
+  int capacity;     //carts the cart and transform buffers have room for
+};
+
+#endif
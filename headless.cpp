@@ -0,0 +1,817 @@
+#include "headless.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "blocksystem.h"
+#include "framekernel.h"
+#include "frametable.h"
+#include "packedframes.h"
+#include "parksim.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "sweep.h"
+#include "telemetry.h"
+#include "track.h"
+#include "train.h"
+#include "trainphysics.h"
+
+using namespace std;
+
+const char* optionValue(int argc, char** argv, int* a, const char* name)
+{
+  if (strcmp(argv[*a], name) != 0 || *a + 1 >= argc)
+    return 0;
+  return argv[++*a];
+}
+
+bool parseRunOption(int argc, char** argv, int* a, HeadlessOptions* options)
+{
+  const char* value;
+  if ((value = optionValue(argc, argv, a, "--track")))
+  {
+    options->track = value;
+    options->tracks.push_back(value);
+  }
+  else if ((value = optionValue(argc, argv, a, "--seconds")))
+    options->seconds = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--trains")))
+    options->trains = atoi(value);
+  else if ((value = optionValue(argc, argv, a, "--cars")))
+    options->cars = atoi(value);
+  else if ((value = optionValue(argc, argv, a, "--sim-rate")))
+    options->simRate = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--blocks")))
+    options->blocks = atoi(value);
+  else if ((value = optionValue(argc, argv, a, "--copies")))
+    options->copies = atoi(value);
+  else if ((value = optionValue(argc, argv, a, "--threads")))
+    options->threads = atoi(value);
+  else if ((value = optionValue(argc, argv, a, "--seed")))
+    options->seed = strtoull(value, 0, 10);
+  else if ((value = optionValue(argc, argv, a, "--replay")))
+    options->replay = value;
+  else if ((value = optionValue(argc, argv, a, "--telemetry")))
+    options->telemetry = value;
+  else if ((value = optionValue(argc, argv, a, "--snapshot")))
+    options->snapshot = value;
+  else if ((value = optionValue(argc, argv, a, "--restore")))
+    options->restore = value;
+  else
+    return false;
+  return true;
+}
+
+bool parseParkOption(int argc, char** argv, int* a, ParkOptions* options)
+{
+  const char* value;
+  if ((value = optionValue(argc, argv, a, "--arrivals")))
+    options->arrivalsPerHour = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--hours")))
+    options->hours = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--day-hours")))
+    options->dayHours = atof(value);
+  else
+    return false;
+  return true;
+}
+
+bool parseSweepOption(int argc, char** argv, int* a, SweepOptions* options)
+{
+  const char* value;
+  if ((value = optionValue(argc, argv, a, "--sweep")))
+    options->runs = atoll(value);
+  else if ((value = optionValue(argc, argv, a, "--param")))
+    options->params.push_back(value);
+  else
+    return false;
+  return true;
+}
+
+bool checkRunOptions(const HeadlessOptions& options, int checks)
+{
+  struct Rule {
+    int check;
+    const char* name;
+    bool ok;
+  };
+  const Rule rules[] = {
+    { CHECK_TRAINS, "--trains", options.trains >= 1 },
+    { CHECK_CARS, "--cars", options.cars >= 1 },
+    { CHECK_COPIES, "--copies", options.copies >= 1 },
+    { CHECK_BLOCKS, "--blocks", options.blocks >= 1 },
+    { CHECK_SECONDS, "--seconds", options.seconds > 0.0 },
+    { CHECK_SIM_RATE, "--sim-rate", options.simRate > 0.0 }
+  };
+
+  vector<const char*> names;
+  bool ok = true;
+  for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++)
+  {
+    if (!(checks & rules[r].check))
+      continue;
+    names.push_back(rules[r].name);
+    ok = ok && rules[r].ok;
+  }
+  if (ok)
+    return true;
+
+  string list = names[0];
+  for (size_t n = 1; n + 1 < names.size(); n++)
+  {
+    list += string(", ") + names[n];
+  }
+  if (names.size() > 1)
+    list += string(" and ") + names.back();
+  printf("ERROR: %s must be positive \n", list.c_str());
+  return false;
+}
+
+bool loadTrack(const string& file, vector<vec3>* points, TrackSegments* segments)
+{
+  try
+  {
+    loadControlPoints(points, file, false);
+    subdivideCurve(points, CURVE_SUBDIVISIONS);
+    if (points->size() < 2)
+    {
+      printf("ERROR: track %s has no points \n", file.c_str());
+      return false;
+    }
+    *segments = loadTrackSegments(file, *points);
+  } catch (const std::exception& e)
+  {
+    printf("ERROR: %s: %s \n", file.c_str(), e.what());
+    return false;
+  }
+  return true;
+}
+
+double peakMemoryMB()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;    //ru_maxrss is in kilobytes on Linux
+}
+
+//CPU time used by the calling thread, in seconds
+static double threadCpuSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+int runHeadless(const HeadlessOptions& options)
+{
+  if (!checkRunOptions(options, CHECK_RUN | CHECK_CARS))
+    return -1;
+
+  vector<vec3> curve_points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &curve_points, &segments))
+    return -1;
+  VelocityProfile profile(curve_points, segments);
+  uint32_t trackChecksum = checksumTrack(curve_points, profile);
+
+  //Spread the trains evenly around the track, or carry on from a snapshot
+  typedef std::chrono::steady_clock Clock;
+  Snapshot warm;
+  double loadSeconds = 0.0;
+  if (!options.restore.empty())
+  {
+    Clock::time_point loadStart = Clock::now();
+    try
+    {
+      warm.load(options.restore);
+    } catch (const std::exception& e)
+    {
+      printf("ERROR: %s: %s \n", options.restore.c_str(), e.what());
+      return -1;
+    }
+    loadSeconds = std::chrono::duration<double>(Clock::now() - loadStart).count();
+    if (warm.header().trackChecksum != trackChecksum)
+    {
+      printf("ERROR: %s was taken on a different track \n", options.restore.c_str());
+      return -1;
+    }
+    if (warm.header().simRate != options.simRate || warm.header().trains < 1)
+    {
+      printf("ERROR: %s was taken at %.0f Hz with %u trains \n", options.restore.c_str(),
+             warm.header().simRate, warm.header().trains);
+      return -1;
+    }
+  } else
+  {
+    vector<Train> start;
+    float startArcLength = profile.sampleArcLength(segments.start());
+    for (int t = 0; t < options.trains; t++)
+    {
+      start.push_back(Train(profile, startArcLength + t * profile.trackLength() / options.trains,
+                            options.cars, CAR_COUPLING));
+    }
+    warm.capture(0, options.simRate, trackChecksum, start);
+  }
+  uint64_t startTick = warm.header().tick;
+  int numTrains = warm.header().trains;
+  int cars = warm.states()[0].cars;
+
+  vector<Train> trains;
+  int size = curve_points.size();
+
+  //Each tick also builds every car's model matrix, as a renderer would
+  FrameTable frameTable(curve_points);
+  int numCars = 0;
+  for (int t = 0; t < numTrains; t++)
+  {
+    numCars += warm.states()[t].cars;
+  }
+  vector<float> arcLengths(numCars);
+  vector<mat4> modelMatrices(numCars);
+  double frameSeconds = 0.0;
+
+  //With --telemetry every train's state goes to a file each step
+  TelemetryWriter telemetry;
+  if (!options.telemetry.empty() &&
+      !telemetry.open(options.telemetry, options.simRate, curve_points, profile, frameTable))
+  {
+    printf("ERROR: unable to create %s \n", options.telemetry.c_str());
+    return -1;
+  }
+
+  const double simDt = 1.0 / options.simRate;
+  long long steps = (long long)(options.seconds * options.simRate);
+
+  double wallSeconds = 0.0;
+  double restoreSeconds = 0.0;
+
+  //What telemetry costs the simulation thread is the time spent in push,
+  //and, less exactly, that thread's CPU clock against a first run without
+  //it. The second also catches the writer thread's cache traffic, which is
+  //all noise when both threads share one core.
+  double baseCpuSeconds = 0.0;
+  double cpuSeconds = 0.0;
+  double pushSeconds = 0.0;
+  for (int pass = telemetry.isOpen() ? 0 : 1; pass < 2; pass++)
+  {
+    bool record = (pass == 1 && telemetry.isOpen());
+    Clock::time_point restoreStart = Clock::now();
+    warm.restore(profile, &trains);
+    restoreSeconds = std::chrono::duration<double>(Clock::now() - restoreStart).count();
+    frameSeconds = 0.0;
+
+    double cpuStart = threadCpuSeconds();
+    Clock::time_point start = Clock::now();
+    for (long long n = 0; n < steps; n++)
+    {
+      for (size_t t = 0; t < trains.size(); t++)
+      {
+        trains[t].step(simDt);
+      }
+
+      if (record)
+      {
+        Clock::time_point pushStart = Clock::now();
+        telemetry.push(startTick + n, &trains[0], trains.size());
+        pushSeconds += std::chrono::duration<double>(Clock::now() - pushStart).count();
+      }
+
+      Clock::time_point frameStart = Clock::now();
+      float* out = &arcLengths[0];
+      for (size_t t = 0; t < trains.size(); t++)
+      {
+        trains[t].carArcLengths(1.f, out);
+        out += trains[t].cars();
+      }
+      computeCartFrames(frameTable, &arcLengths[0], numCars, &modelMatrices[0]);
+      frameSeconds += std::chrono::duration<double>(Clock::now() - frameStart).count();
+    }
+    wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    cpuSeconds = threadCpuSeconds() - cpuStart;
+    if (pass == 0)
+      baseCpuSeconds = cpuSeconds;
+  }
+
+  long long laps = 0;
+  uint32_t state = checksumBytes(0, 0);
+  for (size_t t = 0; t < trains.size(); t++)
+  {
+    laps += trains[t].laps();
+    state = checksumBytes(&trains[t].state(), sizeof(TrainState), state);
+  }
+  double trainSteps = (double)steps * trains.size();
+  double carSteps = (double)steps * numCars;
+
+  printf("track:            %s (%d points, %.2f m, lap %.2f s) \n", options.track.c_str(), size,
+         profile.trackLength(), profile.lapTime());
+  printf("simulated:        %.1f s at %.0f Hz, %d trains of %d cars, from step %llu \n", options.seconds,
+         options.simRate, numTrains, cars, (unsigned long long)startTick);
+  printf("wall time:        %.3f s (%.1fx real time) \n", wallSeconds, options.seconds / wallSeconds);
+  printf("sim steps/s:      %.0f \n", steps / wallSeconds);
+  printf("per train-step:   %.1f ns (without frames) \n", 1e9 * (wallSeconds - frameSeconds) / trainSteps);
+  printf("per car frame:    %.1f ns \n", 1e9 * frameSeconds / carSteps);
+  printf("laps completed:   %lld \n", laps);
+  printf("peak memory:      %.1f MB \n", peakMemoryMB());
+  printf("state checksum:   %08x after step %llu \n", state, (unsigned long long)(startTick + steps));
+  if (!options.restore.empty())
+  {
+    printf("restored:         %s, %.1f KB, load %.1f us, restore %.1f us \n", options.restore.c_str(),
+           warm.bytes() / 1024.0, 1e6 * loadSeconds, 1e6 * restoreSeconds);
+  }
+  if (!options.snapshot.empty())
+  {
+    Snapshot end;
+    Clock::time_point captureStart = Clock::now();
+    end.capture(startTick + steps, options.simRate, trackChecksum, trains);
+    double captureSeconds = std::chrono::duration<double>(Clock::now() - captureStart).count();
+    Clock::time_point saveStart = Clock::now();
+    if (!end.save(options.snapshot))
+    {
+      printf("ERROR: unable to write %s \n", options.snapshot.c_str());
+      return -1;
+    }
+    double saveSeconds = std::chrono::duration<double>(Clock::now() - saveStart).count();
+    printf("snapshot:         %s, %.1f KB, capture %.1f us, save %.1f us \n", options.snapshot.c_str(),
+           end.bytes() / 1024.0, 1e6 * captureSeconds, 1e6 * saveSeconds);
+  }
+  if (telemetry.isOpen())
+  {
+    bool ok = telemetry.close();
+    printf("telemetry:        %llu records (%.1f MB) to %s, %llu dropped%s \n",
+           (unsigned long long)telemetry.written(), telemetry.written() * sizeof(TelemetryRecord) / 1048576.0,
+           options.telemetry.c_str(), (unsigned long long)telemetry.dropped(), ok ? "" : ", WRITE FAILED");
+    printf("telemetry cost:   %.1f ns per record in push, %.1f%% of the simulation thread \n",
+           1e9 * pushSeconds / trainSteps, 100.0 * pushSeconds / wallSeconds);
+    printf("                  %+.1f%% simulation thread CPU against a run without (%.3f s without, %.3f s with) \n",
+           100.0 * (cpuSeconds - baseCpuSeconds) / baseCpuSeconds, baseCpuSeconds, cpuSeconds);
+    printf("telemetry writer: %.3f s CPU on its own thread \n", telemetry.writerCpuSeconds());
+  }
+
+  return 0;
+}
+
+int runBlockHeadless(const HeadlessOptions& options)
+{
+  if (!checkRunOptions(options, CHECK_RUN | CHECK_CARS | CHECK_COPIES | CHECK_BLOCKS))
+    return -1;
+
+  vector<string> files = options.tracks;
+  if (files.empty())
+    files.push_back(options.track);
+
+  //One profile per track file, shared by all of its copies
+  vector<VelocityProfile> profiles;
+  vector<float> starts;
+  for (size_t f = 0; f < files.size(); f++)
+  {
+    vector<vec3> points;
+    TrackSegments segments;
+    if (!loadTrack(files[f], &points, &segments))
+      return -1;
+    profiles.push_back(VelocityProfile(points, segments));
+    starts.push_back(profiles.back().sampleArcLength(segments.start()));
+  }
+
+  BlockSystem blocks;
+  float trainLength = options.cars * CAR_COUPLING;
+  for (size_t f = 0; f < files.size(); f++)
+  {
+    float L = profiles[f].trackLength();
+    for (int c = 0; c < options.copies; c++)
+    {
+      int track = blocks.addTrack(profiles[f], options.blocks);
+      for (int t = 0; t < options.trains; t++)
+      {
+        if (blocks.addTrain(track, starts[f] + t * L / options.trains, trainLength) < 0)
+        {
+          printf("ERROR: %d trains of %.1f m don't fit in %d blocks on %s (%.2f m) \n",
+                 options.trains, trainLength, options.blocks, files[f].c_str(), L);
+          return -1;
+        }
+      }
+    }
+  }
+
+  const double simDt = 1.0 / options.simRate;
+  long long steps = (long long)(options.seconds * options.simRate);
+  double worstTick = 0.0;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Clock::time_point tickStart = start;
+
+  for (long long n = 0; n < steps; n++)
+  {
+    blocks.step(simDt);
+
+    Clock::time_point tickEnd = Clock::now();
+    worstTick = std::max(worstTick, std::chrono::duration<double>(tickEnd - tickStart).count());
+    tickStart = tickEnd;
+  }
+
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  long long laps = 0;
+  int held = 0;
+  for (int t = 0; t < blocks.numTrains(); t++)
+  {
+    laps += blocks.laps(t);
+    held += blocks.isHeld(t);
+  }
+  double tick = wallSeconds / steps;
+  double trainSeconds = options.seconds * blocks.numTrains();
+
+  printf("tracks:           %d (%d files x %d copies), %d blocks \n", blocks.numTracks(),
+         (int)files.size(), options.copies, blocks.numBlocks());
+  printf("trains:           %d of %d cars (%.1f m) \n", blocks.numTrains(), options.cars, trainLength);
+  printf("simulated:        %.1f s at %.0f Hz \n", options.seconds, options.simRate);
+  printf("wall time:        %.3f s (%.1fx real time) \n", wallSeconds, options.seconds / wallSeconds);
+  printf("per tick:         %.1f us mean, %.1f us worst (%.1f%% of the %.0f us budget) \n",
+         1e6 * tick, 1e6 * worstTick, 100.0 * tick / simDt, 1e6 * simDt);
+  printf("per train-tick:   %.1f ns \n", 1e9 * tick / blocks.numTrains());
+  printf("holds:            %lld, %.2f%% of train time waiting, %d waiting at the end \n",
+         blocks.holds(), 100.0 * blocks.heldSeconds() / trainSeconds, held);
+  printf("laps completed:   %lld \n", laps);
+  printf("peak memory:      %.1f MB \n", peakMemoryMB());
+
+  return 0;
+}
+
+int runPhysicsHeadless(const HeadlessOptions& options)
+{
+  if (!checkRunOptions(options, CHECK_RUN))
+    return -1;
+
+  vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &points, &segments))
+    return -1;
+
+  //Both models start every train at the speed the energy model gives
+  //there, spread evenly round the track
+  VelocityProfile profile(points, segments);
+  TrainPhysics physics(points, segments);
+  vector<Train> trains;
+  float L = profile.trackLength();
+  float startArcLength = profile.sampleArcLength(segments.start());
+  for (int t = 0; t < options.trains; t++)
+  {
+    float s = startArcLength + t * L / options.trains;
+    physics.addTrain(s, profile.velocityAt(s));
+    trains.push_back(Train(profile, s, 1, 0.f));
+  }
+
+  const float simDt = 1.f / options.simRate;
+  long long steps = (long long)(options.seconds * options.simRate);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (long long n = 0; n < steps; n++)
+  {
+    physics.step(simDt);
+  }
+  double physicsSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  start = Clock::now();
+  for (long long n = 0; n < steps; n++)
+  {
+    for (size_t t = 0; t < trains.size(); t++)
+    {
+      trains[t].step(simDt);
+    }
+  }
+  double profileSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  long long laps = 0;
+  int rollingBack = 0;
+  for (int t = 0; t < physics.numTrains(); t++)
+  {
+    laps += physics.laps(t);
+    rollingBack += (physics.velocity(t) < 0.f);
+  }
+  double trainSteps = (double)steps * options.trains;
+  double distance = laps * (double)L;
+
+  printf("track:            %s (%d points, %.2f m) \n", options.track.c_str(), (int)points.size(), L);
+  printf("simulated:        %d trains for %.1f s at %.0f Hz \n", options.trains, options.seconds, options.simRate);
+  printf("integrator:       %.3f s, %.3g train-steps/s (%.1f ns per train-step) \n", physicsSeconds,
+         trainSteps / physicsSeconds, 1e9 * physicsSeconds / trainSteps);
+  printf("profile lookup:   %.3f s, %.3g train-steps/s (%.1f ns per train-step) \n", profileSeconds,
+         trainSteps / profileSeconds, 1e9 * profileSeconds / trainSteps);
+  printf("lap time:         %.2f s integrated, %.2f s from the energy model \n",
+         (laps > 0) ? options.seconds * options.trains / laps : 0.0, profile.lapTime());
+  printf("laps completed:   %lld (%.0f m), %d trains rolling back at the end \n", laps, distance, rollingBack);
+
+  return 0;
+}
+
+//A wait percentile in minutes, or "> 24 h" past the histogram
+static string waitText(double seconds)
+{
+  if (std::isinf(seconds))
+    return "> 24 h";
+  char text[32];
+  snprintf(text, sizeof(text), "%.1f", seconds / 60.0);
+  return text;
+}
+
+int runParkHeadless(const HeadlessOptions& options, const ParkOptions& parkOptions)
+{
+  if (!checkRunOptions(options, CHECK_TRAINS | CHECK_CARS))
+    return -1;
+  if (parkOptions.hours <= 0.0)
+  {
+    printf("ERROR: --hours must be positive \n");
+    return -1;
+  }
+  if (parkOptions.arrivalsPerHour < 0.0 || parkOptions.dayHours < 0.0)
+  {
+    printf("ERROR: --arrivals and --day-hours can't be negative \n");
+    return -1;
+  }
+
+  vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &points, &segments))
+    return -1;
+  VelocityProfile profile(points, segments);
+
+  ParkOptions park = parkOptions;
+  park.trains = options.trains;
+  park.cars = options.cars;
+  park.seed = options.seed;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  ParkStats stats = runPark(profile, park);
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  int seats = park.cars * park.seatsPerCar;
+  //A train can leave once per station stay, or once per cycle over the trains
+  double interval = std::max(park.unloadTime + park.loadTime, stats.cycleTime / park.trains);
+
+  printf("track:            %s (lap %.1f s:", options.track.c_str(), profile.lapTime());
+  for (int t = 0; t < SEGMENT_TYPE_COUNT; t++)
+  {
+    if (profile.segmentTime((SegmentType)t) > 0.f)
+      printf(" %s %.1f", segmentTypeName((SegmentType)t), profile.segmentTime((SegmentType)t));
+  }
+  printf(") \n");
+  printf("ride:             %d trains of %d seats, unload %.0f s, load %.0f s, cycle %.1f s \n",
+         park.trains, seats, park.unloadTime, park.loadTime, stats.cycleTime);
+  printf("simulated:        %.1f h open over %d days of %.0f h, %lld events in %.3f s \n",
+         park.hours, stats.days, park.dayHours > 0.0 ? park.dayHours : park.hours, stats.events, wallSeconds);
+  printf("arrivals:         %lld (%.0f per hour) \n", stats.arrivals, park.arrivalsPerHour);
+  printf("throughput:       %.0f riders/hour while open (capacity %.0f), %lld dispatches, %.0f%% seats filled \n",
+         stats.ridersPerHour, seats * 3600.0 / interval, stats.dispatches, 100.0 * stats.meanLoad);
+  printf("wait:             mean %.1f min, p50 %s, p90 %s, p99 %s, max %.1f min \n",
+         stats.meanWait / 60.0, waitText(stats.p50Wait).c_str(), waitText(stats.p90Wait).c_str(),
+         waitText(stats.p99Wait).c_str(), stats.maxWait / 60.0);
+  printf("wait bands:       <5 min %.1f%%, 5-15 %.1f%%, 15-30 %.1f%%, 30-60 %.1f%%, 60+ %.1f%% \n",
+         100.0 * stats.waitBands[0], 100.0 * stats.waitBands[1], 100.0 * stats.waitBands[2],
+         100.0 * stats.waitBands[3], 100.0 * stats.waitBands[4]);
+  printf("queue:            longest %d, %lld riders waited over 24 h \n", stats.maxQueue, stats.longWaits);
+  printf("after closing:    %lld riders from the queue, emptied up to %.1f min late \n",
+         stats.afterClose, stats.maxOvertime / 60.0);
+  printf("overtime:         %.1f h over %d days, %.1f min a day on average \n", stats.overtime / 3600.0,
+         stats.days, stats.overtime / 60.0 / stats.days);
+
+  return 0;
+}
+
+//Used when no --param is given: the four things asked about most, with
+//enough drag that the mass matters
+const char* DEFAULT_SWEEP_PARAMS[] = {
+  "friction=0:0.02", "mass=300:800", "drag=0.8", "boost=0:4", "brake-decel=1:6"
+};
+
+int runSweepHeadless(const HeadlessOptions& options, const SweepOptions& sweep)
+{
+  vector<string> specs = sweep.params;
+  if (specs.empty())
+    specs.assign(DEFAULT_SWEEP_PARAMS, DEFAULT_SWEEP_PARAMS + sizeof(DEFAULT_SWEEP_PARAMS) / sizeof(DEFAULT_SWEEP_PARAMS[0]));
+
+  vector<SweepParameter> params(specs.size());
+  for (size_t p = 0; p < specs.size(); p++)
+  {
+    if (!parseSweepParameter(specs[p], &params[p]))
+    {
+      printf("ERROR: bad --param %s (friction, mass, drag, boost, brake-boost, brake-decel "
+             "= value, low:high or normal:mean:sd) \n", specs[p].c_str());
+      return -1;
+    }
+  }
+
+  vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &points, &segments))
+    return -1;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Clock::time_point lastReport = start;
+
+  //Running totals are printed about once a second while the sweep goes
+  SweepStats stats = runSweep(points, segments, params, sweep.runs, options.seed, options.threads,
+    [&](const SweepStats& sofar) {
+      Clock::time_point now = Clock::now();
+      if (std::chrono::duration<double>(now - lastReport).count() < 1.0)
+        return;
+      lastReport = now;
+      printf("%lld runs: ride %.3f s, peak %.2f g, %lld stalled \n", sofar.runs,
+             sofar.metric[METRIC_RIDE_TIME].mean, sofar.metric[METRIC_PEAK_G].mean, sofar.stalled);
+      fflush(stdout);
+    });
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  const char* metricNames[METRIC_COUNT] = { "ride time (s)", "peak g", "stop at (m)" };
+
+  printf("track:            %s (%d points, %.2f m) \n", options.track.c_str(), (int)points.size(),
+         VelocityProfile(points, segments).trackLength());
+  printf("runs:             %lld in %.2f s (%.0f runs/s), seed %llu \n", stats.runs, wallSeconds,
+         stats.runs / wallSeconds, options.seed);
+  printf("outcome:          %lld round, %lld stalled in free fall, %lld stopped by the brakes \n",
+         stats.runs - stats.stalled - stats.braked, stats.stalled, stats.braked);
+  printf("\n%-16s %10s %10s %10s %10s %10s \n", "", "runs", "mean", "sd", "min", "max");
+  for (size_t p = 0; p < params.size(); p++)
+  {
+    const RunningStats& r = stats.parameter[p];
+    printf("%-16s %10lld %10.4g %10.4g %10.4g %10.4g \n", params[p].name.c_str(), r.count, r.mean,
+           r.stddev(), r.min, r.max);
+  }
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    const RunningStats& r = stats.metric[m];
+    printf("%-16s %10lld %10.4g %10.4g %10.4g %10.4g \n", metricNames[m], r.count, r.mean,
+           r.stddev(), r.min, r.max);
+  }
+
+  printf("\ncorrelation      %14s %14s %14s \n", metricNames[0], metricNames[1], metricNames[2]);
+  for (size_t p = 0; p < params.size(); p++)
+  {
+    printf("%-16s", params[p].name.c_str());
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+      printf(" %14.3f", stats.correlation[p * METRIC_COUNT + m].correlation());
+    }
+    printf(" \n");
+  }
+
+  return 0;
+}
+
+const double PI_D = 3.14159265358979323846;
+
+//Angle in degrees between two orientations
+double angleBetween(quat a, quat b)
+{
+  //in double precision, float acos can't resolve angles this small
+  double na = sqrt((double)a.x * a.x + (double)a.y * a.y + (double)a.z * a.z + (double)a.w * a.w);
+  double nb = sqrt((double)b.x * b.x + (double)b.y * b.y + (double)b.z * b.z + (double)b.w * b.w);
+  double d = ((double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z + (double)a.w * b.w) / (na * nb);
+  return 2.0 * acos(std::min(1.0, fabs(d))) * 180.0 / PI_D;
+}
+
+int runReplayHeadless(const HeadlessOptions& options)
+{
+  Replay replay;
+  try
+  {
+    replay = loadReplay(options.replay);
+  } catch (const std::exception& e)
+  {
+    printf("ERROR: %s: %s \n", options.replay.c_str(), e.what());
+    return -1;
+  }
+  const ReplayHeader& header = replay.header;
+  if (header.simRate <= 0.0 || header.cars < 1)
+  {
+    printf("ERROR: %s has no simulation rate or cars \n", options.replay.c_str());
+    return -1;
+  }
+
+  vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(header.track, &points, &segments))
+    return -1;
+  VelocityProfile profile(points, segments);
+  if (checksumTrack(points, profile) != header.trackChecksum)
+  {
+    printf("ERROR: %s has changed since %s was recorded \n", header.track.c_str(), options.replay.c_str());
+    return -1;
+  }
+
+  //The recording ran fixed steps, so the display frames don't matter here
+  Train train(profile, header.startArcLength, header.cars, header.coupling);
+  const double simDt = 1.0 / header.simRate;
+  size_t ticks = replay.checksums.size();
+  long long mismatches = 0;
+  long long firstMismatch = -1;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (size_t n = 0; n < ticks; n++)
+  {
+    train.step(simDt);
+    if (checksumTrain(train) != replay.checksums[n])
+    {
+      if (firstMismatch < 0)
+        firstMismatch = n;
+      mismatches++;
+    }
+  }
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("replay:           %s (%s, %d cars at %.0f Hz) \n", options.replay.c_str(),
+         header.track.c_str(), header.cars, header.simRate);
+  printf("recorded:         %zu steps (%.1f s), %zu frames, %zu input events \n", ticks,
+         ticks / header.simRate, replay.frameSteps.size(), replay.events.size());
+  printf("wall time:        %.3f s (%.0f steps/s) \n", wallSeconds, ticks / std::max(wallSeconds, 1e-9));
+  if (mismatches > 0)
+  {
+    printf("result:           DIVERGED at step %lld, %lld of %zu steps differ \n",
+           firstMismatch, mismatches, ticks);
+    return 1;
+  }
+  printf("result:           every step matches \n");
+  return 0;
+}
+
+int runFrameReport(const HeadlessOptions& options)
+{
+  vector<vec3> curve_points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &curve_points, &segments))
+    return -1;
+
+  FrameTable frameTable(curve_points);
+  PackedFrameTable packedFrames(frameTable);
+  int size = frameTable.size();
+
+  //Round trip error of every stored orientation
+  double max10 = 0.0, sum10 = 0.0, max16 = 0.0, sum16 = 0.0;
+  for (int k = 0; k < size; k++)
+  {
+    quat q = frameTable.sampleOrientation(k);
+    double e10 = angleBetween(q, unpackQuat10(packQuat10(q)));
+    double e16 = angleBetween(q, unpackQuat16(packQuat16(q)));
+    max10 = std::max(max10, e10);
+    max16 = std::max(max16, e16);
+    sum10 += e10;
+    sum16 += e16;
+  }
+
+  //Model matrices along the whole track against the full precision ModelMatrix
+  const int COUNT = 100000;
+  vector<float> s(COUNT);
+  for (int n = 0; n < COUNT; n++)
+  {
+    s[n] = frameTable.trackLength() * n / COUNT;
+  }
+  vector<mat4> full(COUNT), packed(COUNT);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  computeCartFrames(frameTable, &s[0], COUNT, &full[0]);
+  double fullSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+  start = Clock::now();
+  computeCartFrames(packedFrames, &s[0], COUNT, &packed[0]);
+  double packedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  double maxElement = 0.0, maxAngle = 0.0, sumAngle = 0.0;
+  for (int n = 0; n < COUNT; n++)
+  {
+    mat4 reference = frameTable.modelMatrix(s[n]);
+    for (int c = 0; c < 3; c++)
+      for (int r = 0; r < 3; r++)
+        maxElement = std::max(maxElement, (double)fabs(reference[c][r] - packed[n][c][r]));
+
+    //undo the mirrored x axis to compare as rotations
+    mat3 a(-vec3(reference[0]), vec3(reference[1]), vec3(reference[2]));
+    mat3 b(-vec3(packed[n][0]), vec3(packed[n][1]), vec3(packed[n][2]));
+    double angle = angleBetween(quat_cast(a), quat_cast(b));
+    maxAngle = std::max(maxAngle, angle);
+    sumAngle += angle;
+  }
+
+  printf("track:                 %s (%d points) \n", options.track.c_str(), size);
+  printf("stored orientations:   10 bit max %.4f deg, mean %.4f deg \n", max10, sum10 / size);
+  printf("                       16 bit max %.6f deg, mean %.6f deg \n", max16, sum16 / size);
+  printf("10 bit model matrices: max element error %.2e, max %.4f deg, mean %.4f deg (%d carts) \n",
+         maxElement, maxAngle, sumAngle / COUNT, COUNT);
+  printf("bytes per point:       mat4 %d, quat + position %d, 10 bit + position %d \n",
+         (int)sizeof(mat4), (int)(sizeof(quat) + sizeof(vec3)), (int)(sizeof(uint32_t) + sizeof(vec3)));
+  printf("orientation only:      mat3 %d, quat %d, 16 bit %d, 10 bit %d \n",
+         (int)sizeof(mat3), (int)sizeof(quat), (int)sizeof(uint64_t), (int)sizeof(uint32_t));
+  printf("packed table:          %d bytes \n", (int)packedFrames.bytes());
+  printf("frame kernel:          full %.1f ns per cart, 10 bit %.1f ns per cart \n",
+         1e9 * fullSeconds / COUNT, 1e9 * packedSeconds / COUNT);
+
+  return 0;
+}
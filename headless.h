@@ -0,0 +1,111 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "parksim.h"
+#include "tracksegments.h"
+
+using namespace glm;
+
+//Settings every run without a window shares. Each mode with more of its
+//own keeps them in its module's options struct, read by its own parser.
+struct HeadlessOptions {
+  std::string track;
+  std::vector<std::string> tracks;    //every --track given, for block sections
+  double seconds;     //simulated time to run for
+  int trains;
+  int cars;           //cars per train
+  double simRate;     //fixed simulation steps per simulated second
+  int blocks;         //block sections per track, 0 runs trains without them
+  int copies;         //separate circuits built from each track file
+  int threads;              //0 uses one per core
+  unsigned long long seed;
+  std::string replay;       //replay file to check, see replay.h
+  std::string telemetry;    //file to stream per step train state to, see telemetry.h
+  std::string snapshot;     //file to save the trains to at the end, see snapshot.h
+  std::string restore;      //snapshot file to start the trains from
+
+  HeadlessOptions(): track("./Track3.con"), seconds(60.0), trains(1), cars(1), simRate(240.0),
+                     blocks(0), copies(1), threads(0), seed(1) {}
+};
+
+//Settings for runSweepHeadless
+struct SweepOptions {
+  long long runs;                   //ride profiles to try, 0 for no sweep
+  std::vector<std::string> params;  //--param specs, see parseSweepParameter
+
+  SweepOptions(): runs(0) {}
+};
+
+//Command line parsers. Each reads argv[*a] into its options if it is one
+//of theirs, moving *a onto the option's value if it has one, and returns
+//false if it isn't.
+bool parseRunOption(int argc, char** argv, int* a, HeadlessOptions* options);
+bool parseParkOption(int argc, char** argv, int* a, ParkOptions* options);
+bool parseSweepOption(int argc, char** argv, int* a, SweepOptions* options);
+
+//For the parsers: the value after argv[*a] if it is option name and has
+//one, with *a moved onto it, otherwise null
+const char* optionValue(int argc, char** argv, int* a, const char* name);
+
+//Options checkRunOptions can require to be positive
+enum RunOptionCheck {
+  CHECK_TRAINS = 1,
+  CHECK_CARS = 2,
+  CHECK_COPIES = 4,
+  CHECK_BLOCKS = 8,
+  CHECK_SECONDS = 16,
+  CHECK_SIM_RATE = 32,
+  CHECK_RUN = CHECK_TRAINS | CHECK_SECONDS | CHECK_SIM_RATE   //what every timed run needs
+};
+
+//Returns false, printing which options must be positive, unless every
+//option named in checks is
+bool checkRunOptions(const HeadlessOptions& options, int checks);
+
+//Loads a track file quietly with its segments, printing why if it can't
+bool loadTrack(const std::string& file, std::vector<vec3>* points, TrackSegments* segments);
+
+//Peak resident set size of this process in megabytes
+double peakMemoryMB();
+
+//Runs the simulation as fast as possible and prints throughput statistics,
+//streaming telemetry if options.telemetry is set. The trains start from
+//options.restore if it is set and are saved to options.snapshot at the end.
+//Returns the process exit code.
+int runHeadless(const HeadlessOptions& options);
+
+//Runs options.trains trains on each copy of each track with block
+//sections, as fast as possible, and prints the cost per tick
+int runBlockHeadless(const HeadlessOptions& options);
+
+//Runs options.trains single car trains on options.track with the force
+//integrator in TrainPhysics and with the energy model's speed table, and
+//prints train-steps per second for each and the lap times they give
+int runPhysicsHeadless(const HeadlessOptions& options);
+
+//Runs the discrete event park simulation on options.track, with
+//options.trains trains of options.cars cars and the rest from park, and
+//prints throughput and the wait time distribution
+int runParkHeadless(const HeadlessOptions& options, const ParkOptions& park);
+
+//Runs a Monte Carlo sweep of the ride parameters on options.track and
+//prints the statistics of ride time, peak g and stopping position
+int runSweepHeadless(const HeadlessOptions& options, const SweepOptions& sweep);
+
+//Replays options.replay as fast as possible, checking the state after
+//every step against the recorded checksums. Returns 0 if every step
+//matches.
+int runReplayHeadless(const HeadlessOptions& options);
+
+//Compares the cart frames built from the packed quaternion tables with
+//the full precision FrameTable on options.track, and prints the errors,
+//memory use and kernel cost
+int runFrameReport(const HeadlessOptions& options);
+
+#endif
@@ -0,0 +1,185 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+
+JobGraph::Job JobGraph::add(std::function<void()> work, std::initializer_list<Job> before)
+{
+  Job job = nodes.size();
+  nodes.push_back(Node());
+  nodes[job].work = work;
+  nodes[job].dependencies = before.size();
+  for (Job b : before)
+  {
+    nodes[b].next.push_back(job);
+  }
+  return job;
+}
+
+JobGraph::Job JobGraph::parallelFor(int count, int grain, std::function<void(int begin, int end)> work,
+                                    std::initializer_list<Job> before)
+{
+  grain = std::max(grain, 1);
+  Job start = add(std::function<void()>(), before);
+  Job done = add(std::function<void()>());
+  for (int begin = 0; begin < count; begin += grain)
+  {
+    int end = std::min(begin + grain, count);
+    Job piece = add([work, begin, end]() { work(begin, end); }, { start });
+    nodes[piece].next.push_back(done);
+    nodes[done].dependencies++;
+  }
+  if (nodes[done].dependencies == 0)
+  {
+    nodes[start].next.push_back(done);
+    nodes[done].dependencies++;
+  }
+  return done;
+}
+
+JobSystem::JobSystem(int threads): graph(0), queued(0), remaining(0), executed(0), stolen(0), stopping(false)
+{
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int t = 0; t < threads; t++)
+  {
+    queues.push_back(new Queue());
+  }
+  for (int t = 1; t < threads; t++)
+  {
+    workers.push_back(std::thread(&JobSystem::worker, this, t));
+  }
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleepLock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t t = 0; t < workers.size(); t++)
+  {
+    workers[t].join();
+  }
+  for (size_t q = 0; q < queues.size(); q++)
+  {
+    delete queues[q];
+  }
+}
+
+void JobSystem::push(int self, int job)
+{
+  {
+    std::lock_guard<std::mutex> lock(queues[self]->lock);
+    queues[self]->jobs.push_back(job);
+  }
+  queued++;
+  //Taking the lock means a thread can't check for work, miss this job and
+  //then go to sleep after the notify
+  {
+    std::lock_guard<std::mutex> lock(sleepLock);
+  }
+  wake.notify_one();
+}
+
+bool JobSystem::take(int self, int* job)
+{
+  int n = queues.size();
+  for (int i = 0; i < n; i++)
+  {
+    Queue* queue = queues[(self + i) % n];
+    std::lock_guard<std::mutex> lock(queue->lock);
+    if (queue->jobs.empty())
+      continue;
+    if (i == 0)
+    {
+      *job = queue->jobs.back();
+      queue->jobs.pop_back();
+    } else
+    {
+      *job = queue->jobs.front();
+      queue->jobs.pop_front();
+      stolen++;
+    }
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+void JobSystem::execute(int self, int job)
+{
+  const JobGraph::Node& node = graph->nodes[job];
+  if (node.work)
+    node.work();
+  executed++;
+
+  for (size_t i = 0; i < node.next.size(); i++)
+  {
+    if (--waiting[node.next[i]] == 0)
+      push(self, node.next[i]);
+  }
+  if (--remaining == 0)
+  {
+    std::lock_guard<std::mutex> lock(sleepLock);
+    wake.notify_all();
+  }
+}
+
+void JobSystem::worker(int self)
+{
+  for (;;)
+  {
+    int job;
+    if (take(self, &job))
+    {
+      execute(self, job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepLock);
+    wake.wait(lock, [this]() { return stopping || queued > 0; });
+    if (stopping)
+      return;
+  }
+}
+
+void JobSystem::run(const JobGraph& jobs)
+{
+  int size = jobs.size();
+  if (size == 0)
+    return;
+
+  graph = &jobs;
+  if ((int)waiting.size() != size)
+  {
+    std::vector<std::atomic<int> > counts(size);
+    waiting.swap(counts);
+  }
+  for (int j = 0; j < size; j++)
+  {
+    waiting[j] = jobs.nodes[j].dependencies;
+  }
+  remaining = size;
+
+  //Jobs with nothing to wait for are dealt out so every thread starts busy
+  int n = queues.size();
+  int next = 0;
+  for (int j = 0; j < size; j++)
+  {
+    if (jobs.nodes[j].dependencies == 0)
+      push(next++ % n, j);
+  }
+
+  while (remaining > 0)
+  {
+    int job;
+    if (take(0, &job))
+    {
+      execute(0, job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepLock);
+    wake.wait(lock, [this]() { return queued > 0 || remaining == 0; });
+  }
+  graph = 0;
+}
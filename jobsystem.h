@@ -0,0 +1,91 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+//The work of one frame as jobs and what each has to wait for. Build it
+//once and run it every frame; the jobs keep references to whatever they
+//work on. Jobs must not throw.
+class JobGraph {
+public:
+  typedef int Job;
+
+  //Adds work that starts once every job in before is done
+  Job add(std::function<void()> work, std::initializer_list<Job> before = {});
+
+  //Adds work(begin, end) over [0, count) in pieces of grain, all of them
+  //starting once before is done. Returns a job that is done when every
+  //piece is.
+  Job parallelFor(int count, int grain, std::function<void(int begin, int end)> work,
+                  std::initializer_list<Job> before = {});
+
+  void clear() { nodes.clear(); }
+  int size() const { return nodes.size(); }
+
+private:
+  friend class JobSystem;
+
+  struct Node {
+    std::function<void()> work;
+    std::vector<Job> next;    //jobs waiting on this one
+    int dependencies;
+  };
+
+  std::vector<Node> nodes;
+};
+
+//Work stealing scheduler. Every thread has its own deque: it pushes the
+//jobs it makes ready on the back and takes its next one from the back,
+//so a chain of jobs stays on one core, and a thread that runs out steals
+//the oldest job from the front of someone else's. The thread calling
+//run works as well, so threads includes it.
+class JobSystem {
+public:
+  //threads 0 uses one per core
+  explicit JobSystem(int threads = 0);
+  ~JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  //Runs every job of graph in dependency order and returns when they are
+  //all done. Not to be called from a job.
+  void run(const JobGraph& graph);
+
+  int threads() const { return queues.size(); }
+  uint64_t jobsRun() const { return executed; }
+  uint64_t jobsStolen() const { return stolen; }
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<int> jobs;
+  };
+
+  void worker(int self);
+  void push(int self, int job);
+  bool take(int self, int* job);
+  void execute(int self, int job);
+
+  std::vector<Queue*> queues;     //0 is the thread calling run
+  std::vector<std::thread> workers;
+  const JobGraph* graph;
+  std::vector<std::atomic<int> > waiting;   //unfinished dependencies of each job this run
+  std::atomic<int> queued;        //jobs sitting in the deques
+  std::atomic<int> remaining;     //jobs of this run not finished
+  std::atomic<uint64_t> executed, stolen;
+
+  //Idle threads sleep here until there is something to take
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  bool stopping;
+};
+
+#endif
@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <vector>
 #include <cstdlib>
+#include <chrono>
 
 #include "glm/glm.hpp"
 #include <glm/gtc/type_ptr.hpp>
@@ -27,9 +28,23 @@
 #include <GLFW/glfw3.h>
 
 #include "camera.h"
-
-#include "Vec3f.h"
-#include "Vec3f_FileIO.h"
+#include "framejobs.h"
+#include "framekernel.h"
+#include "frametable.h"
+#include "gpuframes.h"
+#include "headless.h"
+#include "optimizer.h"
+#include "parkcluster.h"
+#include "socketio.h"
+#include "statestream.h"
+#include "replay.h"
+#include "shaderprogram.h"
+#include "supports.h"
+#include "telemetry.h"
+#include "track.h"
+#include "trackquery.h"
+#include "train.h"
+#include "velocityprofile.h"
 
 
 #define PI 3.14159265359
@@ -43,10 +58,6 @@ void QueryGLVersion();
 string LoadSource(const string &filename);
 GLuint CompileShader(GLenum shaderType, const string &source);
 GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
-void loadVec3fFromFile( VectorContainerVec3f & vecs, std::string const & fileName );
-
-double calculate_x(vec3 pos_prev, vec3 pos_current,vec3 pos_next);
-double calculate_c(vec3 pos_past, vec3 pos_future);
 
 
 vec2 mousePos;
@@ -54,16 +65,28 @@ bool leftmousePressed = false;
 bool rightmousePressed = false;
 
 Camera* activeCamera;
+TrackQuery* trackQuery = 0;
 
 GLFWwindow* window = 0;
 
 mat4 winRatio = mat4(1.f);
 
-const vec3 GRAVITY = vec3(0, 9.81, 0);
 bool isFirstPerson = false;
 
+//With --record every step and input goes to the file, with --replay the
+//input comes from the recording instead of the window
+ReplayRecorder recorder;
+const Replay* replay = 0;
+
 
+//Cars in the train
 const int NUMCARTS = 10;
+
+//Physics runs at a fixed rate no matter how fast the display refreshes
+const double DEFAULT_SIM_RATE = 240.0;
+//Longest frame the simulation will try to catch up on, so a stall
+//doesn't turn into a burst of thousands of steps
+const double MAX_FRAME_TIME = 0.25;
 // --------------------------------------------------------------------------
 // GLFW callback functions
 
@@ -74,8 +97,8 @@ void ErrorCallback(int error, const char* description)
     cout << description << endl;
 }
 
-// handles keyboard input events
-void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+// handles keyboard input events, from the window or a replay
+void handleKey(int key, int action)
 {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
@@ -102,10 +125,16 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
       } else {
         isFirstPerson = true;
       }
+    } else if (key == GLFW_KEY_N && action == GLFW_PRESS && trackQuery)
+    {
+      //Report where on the track the camera is closest to
+      TrackHit hit = trackQuery->nearest(activeCamera->pos);
+      printf("Nearest track point to the camera: s = %f of %f (segment %i), distance %f \n",
+             hit.s, trackQuery->trackLength(), hit.segment, hit.distance);
     }
 }
 
-void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+void handleMouseButton(int button, int action)
 {
 	if( (action == GLFW_PRESS) || (action == GLFW_RELEASE) ){
 		if(button == GLFW_MOUSE_BUTTON_LEFT)
@@ -115,13 +144,9 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	}
 }
 
-void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
+//newPos is in -1..1 window coordinates
+void handleMousePos(vec2 newPos)
 {
-	int vp[4];
-	glGetIntegerv(GL_VIEWPORT, vp);
-
-	vec2 newPos = vec2(xpos/(double)vp[2], -ypos/(double)vp[3])*2.f - vec2(1.f);
-
 	vec2 diff = newPos - mousePos;
 	if(leftmousePressed){
 		activeCamera->trackballRight(-diff.x);
@@ -136,6 +161,46 @@ void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
 	mousePos = newPos;
 }
 
+void applyReplayEvent(const ReplayEvent& e)
+{
+  if (e.type == REPLAY_KEY)
+    handleKey(e.a, e.b);
+  else if (e.type == REPLAY_MOUSE_BUTTON)
+    handleMouseButton(e.a, e.b);
+  else if (e.type == REPLAY_MOUSE_POS)
+    handleMousePos(vec2(e.x, e.y));
+}
+
+//While replaying only escape gets through from the window
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+  if (replay && key != GLFW_KEY_ESCAPE)
+    return;
+  recorder.event(REPLAY_KEY, key, action);
+  handleKey(key, action);
+}
+
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+  if (replay)
+    return;
+  recorder.event(REPLAY_MOUSE_BUTTON, button, action);
+  handleMouseButton(button, action);
+}
+
+void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
+{
+  if (replay)
+    return;
+
+	int vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+
+	vec2 newPos = vec2(xpos/(double)vp[2], -ypos/(double)vp[3])*2.f - vec2(1.f);
+  recorder.event(REPLAY_MOUSE_POS, 0, 0, newPos.x, newPos.y);
+  handleMousePos(newPos);
+}
+
 void resizeCallback(GLFWwindow* window, int width, int height)
 {
 	int vp[4];
@@ -200,6 +265,22 @@ bool initVAO(GLuint vao, const VertexBuffers& vbo)
 	return !CheckGLErrors("initVAO");		//Check for errors in initialize
 }
 
+//The same, plus a model matrix per instance from transforms in attributes
+//2 to 5 (a mat4 takes one attribute per column)
+bool initInstancedVAO(GLuint vao, const VertexBuffers& vbo, GLuint transforms)
+{
+  initVAO(vao, vbo);
+
+  glBindBuffer(GL_ARRAY_BUFFER, transforms);
+  for (int c = 0; c < 4; c++)
+  {
+    glEnableVertexAttribArray(2 + c);
+    glVertexAttribPointer(2 + c, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(c * sizeof(vec4)));
+    glVertexAttribDivisor(2 + c, 1);   //advance once per instance, not per vertex
+  }
+
+  return !CheckGLErrors("initInstancedVAO");
+}
 
 //Loads buffers with data
 bool loadBuffer(const VertexBuffers& vbo,
@@ -273,6 +354,14 @@ GLuint initShader(string vertexName, string fragmentName)
 	return LinkProgram(vertexID, fragmentID);	//Link and store program ID in shader array
 }
 
+//Compile and link a compute shader on its own
+GLuint initComputeShader(string computeName)
+{
+  GLuint computeID = CompileShader(GL_COMPUTE_SHADER, LoadSource(computeName));
+
+  return LinkProgram(computeID, 0);
+}
+
 //Initialization
 void initGL()
 {
@@ -284,23 +373,6 @@ void initGL()
 	glClearColor(0.f, 0.f, 0.f, 0.f);		//Color to clear the screen with (R, G, B, Alpha)
 }
 
-bool loadUniforms(GLuint program, mat4 perspective, mat4 modelview)
-{
-	glUseProgram(program);
-
-	glUniformMatrix4fv(glGetUniformLocation(program, "modelviewMatrix"),
-						1,
-						false,
-						&modelview[0][0]);
-
-	glUniformMatrix4fv(glGetUniformLocation(program, "perspectiveMatrix"),
-						1,
-						false,
-						&perspective[0][0]);
-
-	return !CheckGLErrors("loadUniforms");
-}
-
 //Draws buffers to screen
 void render(GLuint vao, int startElement, int numElements)
 {
@@ -312,8 +384,15 @@ void render(GLuint vao, int startElement, int numElements)
 			GL_UNSIGNED_INT,	//Type
 			(void*)0			//Offset
 			);
+}
+
+//Draws numInstances copies of the buffers, the vertex program picks each
+//one's transform (cart.vert by instance ID, supports.vert from attributes)
+void renderInstanced(GLuint vao, int numElements, int numInstances)
+{
+  glBindVertexArray(vao);
 
-	CheckGLErrors("render");
+  glDrawElementsInstanced(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, (void*)0, numInstances);
 }
 
 void renderCurve(GLuint vao, int numPoints)
@@ -321,34 +400,19 @@ void renderCurve(GLuint vao, int numPoints)
   glBindVertexArray(vao);
 
   glDrawArrays( GL_LINE_LOOP, 0, numPoints);
-
-  CheckGLErrors("renderCurve");
   //glBindVertexArray(0);
 }
 
-void renderBead(GLuint programBead, vec3 beadPosition, mat4 perspective, mat4 modelview)
+//The matrices come from the uniform blocks, beadLocation is the program's
+//beadPosition uniform
+void renderBead(const ShaderProgram& programBead, GLint beadLocation, vec3 beadPosition)
 {
+  programBead.use();
 
-  glUseProgram(programBead);
-
-
-  glUniformMatrix4fv(glGetUniformLocation(programBead, "modelviewMatrix"),
-            1,
-            GL_FALSE,
-            glm::value_ptr(modelview));
-
-  glUniformMatrix4fv(glGetUniformLocation(programBead, "perspectiveMatrix"),
-            1,
-            GL_FALSE,
-            glm::value_ptr(perspective));
-
-  glUniform3fv(glGetUniformLocation(programBead, "beadPosition"), 1, glm::value_ptr(beadPosition) );
+  glUniform3fv(beadLocation, 1, glm::value_ptr(beadPosition) );
 
   glPointSize(10.0f);
   glDrawArrays(GL_POINTS, 0, 1);
-
-  CheckGLErrors("renderBead");
-
 }
 
 
@@ -377,13 +441,55 @@ void generateSquare(vector<vec3>* vertices, vector<vec3>* normals,
 	indices->push_back(0);
 }
 
+//Unit column for the supports, x and z from -0.5 to 0.5 and y from 0 to 1,
+//four vertices a side so every face gets its own normal
+void generateColumn(vector<vec3>* vertices, vector<vec3>* normals,
+            vector<unsigned int>* indices)
+{
+  const vec3 sides[4] = { vec3(1.f, 0.f, 0.f), vec3(0.f, 0.f, 1.f), vec3(-1.f, 0.f, 0.f), vec3(0.f, 0.f, -1.f) };
+  for (int f = 0; f < 4; f++)
+  {
+    vec3 n = sides[f];
+    vec3 across = vec3(n.z, 0.f, -n.x);
+    unsigned int first = vertices->size();
+    vertices->push_back(0.5f * (n - across));
+    vertices->push_back(0.5f * (n + across));
+    vertices->push_back(0.5f * (n + across) + vec3(0.f, 1.f, 0.f));
+    vertices->push_back(0.5f * (n - across) + vec3(0.f, 1.f, 0.f));
+    for (int v = 0; v < 4; v++)
+      normals->push_back(n);
+
+    indices->push_back(first);
+    indices->push_back(first + 1);
+    indices->push_back(first + 2);
+    indices->push_back(first + 2);
+    indices->push_back(first + 3);
+    indices->push_back(first);
+  }
+
+  //Top cap, the bottom is on the ground
+  unsigned int first = vertices->size();
+  vertices->push_back(vec3(-0.5f, 1.f, -0.5f));
+  vertices->push_back(vec3(-0.5f, 1.f, 0.5f));
+  vertices->push_back(vec3(0.5f, 1.f, 0.5f));
+  vertices->push_back(vec3(0.5f, 1.f, -0.5f));
+  for (int v = 0; v < 4; v++)
+    normals->push_back(vec3(0.f, 1.f, 0.f));
+  indices->push_back(first);
+  indices->push_back(first + 1);
+  indices->push_back(first + 2);
+  indices->push_back(first + 2);
+  indices->push_back(first + 3);
+  indices->push_back(first);
+}
+
 void generatePlane(vector<vec3>* vertices, vector<vec3>* normals,
             vector<unsigned int>* indices, float width)
 {
-  vertices->push_back(vec3(-width*0.5f,  -1.f, -width*0.5f));
-  vertices->push_back(vec3(width*0.5f,  -1.f , -width*0.5f));
-  vertices->push_back(vec3(width*0.5f,  -1.f , width*0.5f));
-  vertices->push_back(vec3(-width*0.5f,  -1.f, width*0.5f));
+  vertices->push_back(vec3(-width*0.5f, GROUND_PLANE_HEIGHT, -width*0.5f));
+  vertices->push_back(vec3(width*0.5f, GROUND_PLANE_HEIGHT, -width*0.5f));
+  vertices->push_back(vec3(width*0.5f, GROUND_PLANE_HEIGHT, width*0.5f));
+  vertices->push_back(vec3(-width*0.5f, GROUND_PLANE_HEIGHT, width*0.5f));
 
   normals->push_back(vec3(1.f, 0.f, 0.f));
   normals->push_back(vec3(1.f, 0.f, 0.f));
@@ -471,230 +577,8 @@ void generateCart(vector<vec3>* vertices, std::vector<vec3>* normals,
 }
 
 
-vec3 arcLengthParameterization(vec3 bead_pos, int& i, vector<vec3> points, double deltaS)
-{
-
-  vec3 newBeadPos;
-  int size = points.size();
-  //assume points is at least i + 1 in size
-
-  //case 1, the distance between the next point is greater than deltaS
-  if (abs(length((points.at((i +1) % size) - bead_pos))) > deltaS)
-  {
-    newBeadPos = bead_pos + (points.at((i + 1) % size) - bead_pos) * (float)((deltaS / abs((length(points.at((i + 1)%size) - bead_pos)))));
-    return newBeadPos;
-  } else
-  {
-    //The distance between the bead postion and the next point is less than or
-    //equal to deltaS
-
-    double s_prime = abs(length((points.at(i % size) - bead_pos)));
-    i +=1;
-
-    while (( s_prime + abs(length(points.at((i + 1) % size) - points.at(i % size) ))  ) < deltaS)
-    {
-      s_prime = s_prime + abs((length(points.at((i + 1) % size)  - points.at(i % size))));
-      i += 1;
-    }
-
-    newBeadPos = bead_pos + (points.at((i + 1)%size) - points.at(i % size)) * (float)(abs((deltaS - s_prime))/(abs((length(points.at( (i+ 1) % size) - points.at(i % size))))));
-
-    return newBeadPos;
-  }
-}
-
-mat4 makeFresnetFrame(vec3 bead_pos, vector<vec3> curve_points, double velocity,  int i)
-{
-
-  double vs = velocity * 1.0f/60.0f;
-
-  vec3 beadPos_tmp = arcLengthParameterization(beadPos_tmp, i, curve_points, vs);
-
-  vec3 beadPos_prev = curve_points.at( (i - 10) % curve_points.size());
-  vec3 beadPos_future = curve_points.at( (i + 10) % curve_points.size());
-  double x = calculate_x(beadPos_prev, beadPos_tmp ,beadPos_future);
-  double c = calculate_c(beadPos_prev, beadPos_future);
-
-  double r = (pow(x, 2) + pow(c, 2))/(2 * x);
-  double k = 1.0f/r;
-
-  vec3 n = 1.0f/(length(beadPos_future - 2.0f * beadPos_tmp + beadPos_prev))
-             *  (beadPos_future - 2.0f * beadPos_tmp + beadPos_prev);
-
-  vec3 acc_perpendicular = (float) k * n;
-
-  vec3 Normal_cart = +(acc_perpendicular + GRAVITY);
-
-  vec3 Tangent = beadPos_future - beadPos_prev;
-  vec3 T_tmp = normalize(Tangent);
-
-  vec3 normalizd_Normal_cart = normalize(Normal_cart);
-
-  vec3 B = cross(T_tmp, normalizd_Normal_cart);
-  vec3 normalized_B = normalize(B);
-
-  vec3 T = cross(normalizd_Normal_cart, normalized_B);
-  vec3 T_hat = normalize(T);
-  mat4 ModelMatrix = mat4(vec4(normalized_B,0), vec4(normalizd_Normal_cart,0),  vec4(T_hat,0), vec4(beadPos_tmp, 1));
-  return ModelMatrix;
-}
-
-int highestPoint(std::vector<vec3> points)
-{
-  //assume points is at least one element
-
-  int index = 0;
-  vec3 highestPoint = points.at(0);
-
-  for (int i = 0; i < points.size(); i++)
-  {
-    if ( points.at(i).y > highestPoint.y)
-    {
-      index = i;
-      highestPoint = points.at(i);
-    }
-  }
-
-  return index;
-}
-
-
-void generateSecondLineForTrack(vector<vec3> current_Points,
-                                vector<vec3>* newPoints1,
-                                std::vector<vec3>* newPoints2,
-                                vector<vec3>* normals)
-{
-    for (int i = 0; i < current_Points.size(); i++)
-    {
-      vec3 posFuture = current_Points.at( (i + 1)%current_Points.size());
-      vec3 posPast = current_Points.at( (i - 1)%current_Points.size());
-      vec3 posCurrent = current_Points.at(i);
-
-      double x = calculate_x(posPast, posCurrent, posFuture);
-      double c = calculate_c(posPast, posFuture);
-
-      vec3 acc_perpendicular = (float)(1.0f/(pow(x,2) + pow(c,2)))
-                          * (posFuture - 2.0f * posCurrent + posPast);
-      vec3 normal = acc_perpendicular + GRAVITY;
-
-      vec3 Tangent = posFuture - posCurrent;
-      vec3 normalized_Tangent = normalize(Tangent);
-
-      vec3 normalized_normal = normalize(normal);
-
-      vec3 B = cross(normalized_Tangent, normalized_normal);
-      vec3 B_hat = normalize(B);
-
-      vec3 newPoint1 = posCurrent + 0.3f * B_hat;
-      vec3 newPoint2 = posCurrent - 0.3f * B_hat;
-      newPoints1->push_back(newPoint1);
-      newPoints2->push_back(newPoint2);
-    }
-    //newPoints1->push_back(newPoints->at(0));
-
-    for (int j = 0; j < newPoints1->size(); j++)
-    {
-      normals->push_back(vec3(0,1,0));
-    }
-}
-
-//This function will make a curve that will be used to make the coaster
-void generateCurve(vector<vec3>* points, vector<vec3>* normals)
-{
-
-    vector<vec3> controlPoints;
-    int subdivisions = 5;
-
-    VectorContainerVec3f vectors;
-
-    std::string file("./Track3.con");
-    std::cout<< "Now reading from file named" << file << "\n";
-    loadVec3fFromFile(vectors, file);
-
-    for (int i = 0; i < vectors.size(); i++)
-    {
-      Vec3f vec = vectors.at(i);
-      std::cout << vec << std::endl;
-      points->push_back(vec3(5 * vec.m_x, 5 * vec.m_z, 5 * vec.m_y));
-    }
-
-
-    //points->at(4).y = 0.2;
-
-    //points->at(5).y = 0.5;
-
-    //Add the control points to the lists
-    //These points will determine the curve
-    /*
-    points->push_back(vec3(0,0,0));
-    points->push_back(vec3(1,0,0));
-    points->push_back(vec3(2,0,0));
-    points->push_back(vec3(3,0.5,2));
-    points->push_back(vec3(3, 1,2));
-    points->push_back(vec3(3, 0, 5));
-    points->push_back(vec3(0, 0, 5));
-    points->push_back(vec3(0,0,0));
-    */
-
-
-
-    int j;
-    for (int i = 0; i < subdivisions; i++)
-    {
-      vector<vec3> Q;
-      //Add the mid points of the control points to the set Q
-      for ( j = 0; j < (points->size() - 1); j++)
-      {
-        Q.push_back(points->at(j));
-        Q.push_back((points->at(j) + points->at(j + 1)) * 0.5f);
-      }
-      //Makes sure the curve connects back to the start
-      Q.push_back(points->at(j));
-      //Q.push_back(points)
-
-      //Clear the points since we will want to make a new
-      //set of points
-      points->clear();
-      int r;
-      //Subdivide the curve so that the new set of points will be smoother
-      for (r = 0; r < (Q.size() - 1); r++)
-      {
-        points->push_back((Q.at(r) + Q.at(r +1)) * 0.5f);
-      }
-      //Add in the first point so that the curve will go back to the start
-      points->push_back(points->at(0));
-    }
-
-
-
-    //Normals is poorly named here should actually be color
-    for (int i = 0; i < points->size(); i++)
-    {
-      normals->push_back(vec3(0.f, 0.f,1.f));
-    }
-
-
-}
-
-//This calculation is used to calculate the x value
-//The x value is an important part to calculating the
-//radius of the curvature circle of the curve
-double calculate_x(vec3 pos_prev, vec3 pos_current,vec3 pos_next)
-{
-
-  double x = 1.0f/2.0f * ( length(pos_next - 2.0f * pos_current + pos_prev));
-  return x;
-}
-
-//C is defined as the half distance between the past point and the future point
-double calculate_c(vec3 pos_past, vec3 pos_future)
-{
-  double c = 1.0f/2.0f * length(pos_future - pos_past);
-  return c;
-}
-
-
-GLFWwindow* createGLFWWindow()
+//compute asks for a 4.3 context, which the GPU cart frames need
+GLFWwindow* createGLFWWindow(bool compute)
 {
 	// initialize the GLFW windowing system
     if (!glfwInit()) {
@@ -705,7 +589,7 @@ GLFWwindow* createGLFWWindow()
 
     // attempt to create a window with an OpenGL 4.1 core profile context
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, compute ? 3 : 1);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     window = glfwCreateWindow(512, 512, "OpenGL Example", 0, 0);
@@ -732,7 +616,147 @@ GLFWwindow* createGLFWWindow()
 
 int main(int argc, char *argv[])
 {
-    window = createGLFWWindow();
+    HeadlessOptions options;
+    options.simRate = DEFAULT_SIM_RATE;
+    ParkOptions parkOptions;
+    SweepOptions sweep;
+    ClusterOptions cluster;
+    StreamOptions stream;
+    SupportOptions supportOptions;
+    OptimizeOptions optimize;
+    //--optimize and --workers choose their modes, and the optimizer keeps
+    //the track's own heights unless told otherwise
+    optimize.candidates = 0;
+    optimize.minHeight = NAN;
+    optimize.maxHeight = NAN;
+    cluster.workers = 0;
+    bool headless = false;
+    bool frameReport = false;
+    bool gpuFrames = false;
+    bool park = false;
+    bool physics = false;
+    bool jobs = false;
+    bool supportReport = false;
+    string recordFile;
+    string workerAddress;
+    for (int a = 1; a < argc; a++)
+    {
+      string arg = argv[a];
+      if (arg == "--headless")
+        headless = true;
+      else if (arg == "--frame-report")
+        frameReport = true;
+      else if (arg == "--supports")
+        supportReport = true;
+      else if (arg == "--gpu-frames")
+        gpuFrames = true;
+      else if (arg == "--physics")
+        physics = true;
+      else if (arg == "--jobs")
+        jobs = true;
+      else if (arg == "--park")
+        park = true;
+      else if (arg == "--record" && a + 1 < argc)
+        recordFile = argv[++a];
+      else if (arg == "--worker" && a + 1 < argc)
+        workerAddress = argv[++a];
+      else if (!parseRunOption(argc, argv, &a, &options) &&
+               !parseParkOption(argc, argv, &a, &parkOptions) &&
+               !parseSweepOption(argc, argv, &a, &sweep) &&
+               !parseClusterOption(argc, argv, &a, &cluster) &&
+               !parseStreamOption(argc, argv, &a, &stream) &&
+               !parseSupportOption(argc, argv, &a, &supportOptions) &&
+               !parseOptimizeOption(argc, argv, &a, &optimize))
+      {
+        cout << "Unknown argument " << arg << endl;
+        return -1;
+      }
+    }
+
+    //Batch mode never opens a window, so it runs on machines without a display
+    bool batch = headless || frameReport || supportReport || park || physics || jobs ||
+                 !workerAddress.empty() || !stream.view.empty() || stream.port >= 0 ||
+                 sweep.runs > 0 || optimize.candidates > 0;
+    //A recording is one train driven from the window, batch modes have neither
+    if (batch && !recordFile.empty())
+    {
+      cout << "ERROR: --record only works in the window, use --telemetry or --snapshot for batch runs" << endl;
+      return -1;
+    }
+    //With --trains the window runs a park, recordings, replays and GPU frames are of one train
+    if (!batch && options.trains > 1 && (!recordFile.empty() || !options.replay.empty() || gpuFrames))
+    {
+      cout << "ERROR: --record, --replay and --gpu-frames only work with one train" << endl;
+      return -1;
+    }
+    if (!workerAddress.empty())
+    {
+      int fd = connectTcp(workerAddress);
+      if (fd < 0)
+      {
+        cout << "ERROR: unable to connect to " << workerAddress << endl;
+        return -1;
+      }
+      return runClusterWorker(fd);
+    }
+    if (!stream.view.empty())
+      return runViewHeadless(options, stream);
+    if (stream.port >= 0)
+      return runStreamHeadless(options, stream);
+    if (park)
+      return runParkHeadless(options, parkOptions);
+    if (physics)
+      return runPhysicsHeadless(options);
+    if (jobs)
+      return runJobsHeadless(options);
+    if (sweep.runs > 0)
+      return runSweepHeadless(options, sweep);
+    if (optimize.candidates > 0)
+      return runOptimizeHeadless(options, optimize);
+    if (headless && !options.replay.empty())
+      return runReplayHeadless(options);
+    if (headless && cluster.workers > 0)
+      return runClusterHeadless(options, cluster);
+    if (headless && options.blocks > 0)
+      return runBlockHeadless(options);
+    if (headless)
+      return runHeadless(options);
+    if (frameReport)
+      return runFrameReport(options);
+    if (supportReport)
+      return runSupportsHeadless(options, supportOptions);
+
+    //A replay runs on the track and at the rate it was recorded with
+    Replay recorded;
+    if (!options.replay.empty())
+    {
+      try
+      {
+        recorded = loadReplay(options.replay);
+      } catch (const std::exception& e)
+      {
+        cout << "ERROR: " << options.replay << ": " << e.what() << endl;
+        return -1;
+      }
+      replay = &recorded;
+      options.track = recorded.header.track;
+      options.simRate = recorded.header.simRate;
+    }
+
+    double simRate = options.simRate;
+    if (simRate <= 0.0)
+    {
+      cout << "ERROR: --sim-rate must be positive" << endl;
+      return -1;
+    }
+
+    window = createGLFWWindow(gpuFrames);
+    if (window == NULL && gpuFrames)
+    {
+      cout << "No OpenGL 4.3 context for --gpu-frames, building cart frames on the CPU" << endl;
+      gpuFrames = false;
+      window = createGLFWWindow(false);
+    }
     if(window == NULL)
     	return -1;
 
@@ -746,11 +770,17 @@ int main(int argc, char *argv[])
     // query and print out information about our OpenGL environment
     QueryGLVersion();
 
+    if (gpuFrames && !GpuCartFrames::loadEntryPoints())
+    {
+      cout << "Compute shaders not available, building cart frames on the CPU" << endl;
+      gpuFrames = false;
+    }
+
 	initGL();
 
 	//Initialize shader
-	GLuint program = initShader("vertex.glsl", "fragment.glsl");
-  GLuint beadProg = initShader("bead.vert", "bead.frag");
+	ShaderProgram program(initShader("vertex.glsl", "fragment.glsl"));
+  ShaderProgram beadProg(initShader("bead.vert", "bead.frag"));
 
 
 
@@ -808,19 +838,18 @@ int main(int argc, char *argv[])
   vector<vec3> curve_points, curve_normals;
   vector<unsigned int> curve_indices;
 
-  generateCurve(&curve_points, &curve_normals);
+  generateCurve(&curve_points, &curve_normals, options.track);
 
   vector<vec3> curve2_points, curve2_normals;
   vector<vec3> curve3_points;
   generateSecondLineForTrack(curve_points, &curve2_points,&curve3_points, &curve2_normals);
 
+  TrackQuery curveQuery(curve_points);
+  trackQuery = &curveQuery;
+
   int index_of_highest_point = highestPoint(curve_points);
   vec3 H = curve_points.at(index_of_highest_point);
   cout << "The highestPoint has a y of " <<  H.y << "\n";
-  vec3 beadPos = curve_points.at(index_of_highest_point);
-
-  vec3 beadPos_prev = beadPos;  //used to calculate the tangential acceleratiion
-  vec3 beadPos_future = beadPos_future; //used to calculate the tangential acceleratiion
 
 	loadBuffer(vbo, points, normals, indices);
   loadBuffer(vbo_plane, plane_points, plane_normals, plane_indices);
@@ -834,81 +863,169 @@ int main(int argc, char *argv[])
 	activeCamera = &cam;
 	//float fovy, float aspect, float zNear, float zFar
 	mat4 perspectiveMatrix = perspective(radians(80.f), 1.f, 0.1f, 20.f);
-  double t = 0;
-  int i = index_of_highest_point;
-  bool phases_of_the_coaster = true;
-
-  bool lifting_stage = false;
-  bool gravityFreeFall = false;
-  bool deacc_Stage = true;
-  double v_dec = 0.0f;
-  double l_dec = 0.0f;
-
-  vector<mat4> modelMatrices;
-
-  vec3 beadPos_tmp = beadPos;
-  int j = index_of_highest_point;
-  for (int a = 0; a < NUMCARTS; a++)
+  //Speed along the track is looked up from here instead of being
+  //recomputed from the stage flags every frame
+  TrackSegments segments = loadTrackSegments(options.track, curve_points);
+  VelocityProfile profile(curve_points, segments);
+
+  ReplayHeader header;
+  header.track = options.track;
+  header.simRate = simRate;
+  header.cars = NUMCARTS;
+  header.coupling = CAR_COUPLING;
+  header.startArcLength = profile.sampleArcLength(segments.start());
+  header.trackChecksum = checksumTrack(curve_points, profile);
+  if (replay)
   {
-    double v_tmp = sqrt( (2.0f * dot(GRAVITY , (H - beadPos_tmp)) + 2.f ));
-
-    double vs = v_tmp * 1.0f/60.0f;
-
-    beadPos_tmp = arcLengthParameterization(beadPos_tmp, j, curve_points,  vs);
-
-    beadPos_prev = curve_points.at( (j - 10) % curve_points.size());
-    beadPos_future = curve_points.at( (j + 10) % curve_points.size());
-    double x = calculate_x(beadPos_prev, beadPos_tmp ,beadPos_future);
-    double c = calculate_c(beadPos_prev, beadPos_future);
-
-    double r = (pow(x, 2) + pow(c, 2))/(2 * x);
-    double k = 1.0f/r;
-
-    vec3 n = 1.0f/(length(beadPos_future - 2.0f * beadPos_tmp + beadPos_prev))
-               *  (beadPos_future - 2.0f * beadPos_tmp + beadPos_prev);
-
-    vec3 acc_perpendicular = (float) k * n;
-
-    vec3 Normal_cart = +(acc_perpendicular + GRAVITY);
-
-        vec3 Tangent = beadPos_future - beadPos_prev;
-        vec3 T_tmp = normalize(Tangent);
-
-        vec3 normalizd_Normal_cart = normalize(Normal_cart);
-
-        vec3 B = cross(T_tmp, normalizd_Normal_cart);
-        vec3 normalized_B = normalize(B);
+    if (replay->header.trackChecksum != header.trackChecksum)
+    {
+      cout << "ERROR: " << options.track << " has changed since " << options.replay << " was recorded" << endl;
+      return -1;
+    }
+    header = replay->header;
+  }
+  if (!recordFile.empty() && !recorder.open(recordFile, header))
+  {
+    cout << "ERROR: unable to create " << recordFile << endl;
+    return -1;
+  }
+  Train train(profile, header.startArcLength, header.cars, header.coupling);
+  printf("Lap time %f s (lifting %f s, free fall %f s, deceleration %f s) \n",
+         profile.lapTime(), profile.dwellTime(STAGE_LIFTING),
+         profile.dwellTime(STAGE_FREE_FALL), profile.dwellTime(STAGE_DECELERATION));
+  for (int i = 0; i < segments.count(); i++)
+  {
+    const TrackSegment& seg = segments.segment(i);
+    printf("  %-8s from %6.2f m, %5.2f m long \n", segmentTypeName(seg.type),
+           profile.sampleArcLength(seg.first), seg.length);
+  }
 
-        vec3 T = cross(normalizd_Normal_cart, normalized_B);
-        vec3 T_hat = normalize(T);
-        mat4 ModelMatrix = mat4(vec4(normalized_B,0), vec4(normalizd_Normal_cart,0),  vec4(T_hat,0), vec4(beadPos_tmp, 1));
-        //printf("The modelMatrices at %i and j is %i is (%f, %f, %f) \n", a, j, beadPos_tmp.x, beadPos_tmp.y,
-        //beadPos_tmp.z);
-        modelMatrices.push_back(ModelMatrix);
+  //Cart orientation is looked up and interpolated instead of rebuilt every
+  //frame, from orientations packed into 32 bits each. The full precision
+  //table is only kept while the supports, telemetry and GPU frames are set
+  //up from it.
+  FrameTable* frameTable = new FrameTable(curve_points);
+  PackedFrameTable packedFrames(*frameTable);
+
+  //Support columns down to the ground plane, built once and drawn with a
+  //single instanced call however many there are
+  ShaderProgram supportProg(initShader("supports.vert", "fragment.glsl"));
+  GLuint support_vao;
+  VertexBuffers support_vbo;
+  GLuint supportTransforms;
+  glGenVertexArrays(1, &support_vao);
+  glGenBuffers(VertexBuffers::COUNT, support_vbo.id);
+  glGenBuffers(1, &supportTransforms);
+  initInstancedVAO(support_vao, support_vbo, supportTransforms);
+
+  vector<vec3> column_points, column_normals;
+  vector<unsigned int> column_indices;
+  generateColumn(&column_points, &column_normals, &column_indices);
+  loadBuffer(support_vbo, column_points, column_normals, column_indices);
+
+  vector<mat4> supports;
+  generateSupports(*frameTable, supportOptions, [](float, float) { return GROUND_PLANE_HEIGHT; }, &supports);
+  glBindBuffer(GL_ARRAY_BUFFER, supportTransforms);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(mat4) * supports.size(), supports.empty() ? 0 : &supports[0], GL_STATIC_DRAW);
+  printf("%d support columns \n", (int)supports.size());
+
+  //The train's state every step, written out by a background thread
+  TelemetryWriter telemetry;
+  uint32_t simTick = 0;
+  if (!options.telemetry.empty() &&
+      !telemetry.open(options.telemetry, simRate, curve_points, profile, *frameTable))
+  {
+    cout << "ERROR: unable to create " << options.telemetry << endl;
+    return -1;
+  }
 
-    //mat4 matrix = ?
-    //modelMatrices.push_back(matrix);
+  //Filled for every car of the train each frame
+  vector<float> carArcLengths(train.cars());
+  vector<mat4> modelMatrices(train.cars());
+  train.carArcLengths(0.f, &carArcLengths[0]);
+
+  //The view goes into FrameBlock once a frame. Everything but the CPU
+  //built carts is drawn with the identity model matrix, object 0, and
+  //car c is object 1 + c.
+  SceneUniforms sceneUniforms(1 + train.cars());
+  mat4 identity(1.f);
+  sceneUniforms.setObjects(0, &identity, 1);
+
+  //With --gpu-frames the cart matrices are built by a compute pass and never
+  //come back to the CPU. Check it once against the CPU kernel at startup.
+  GpuCartFrames* gpuCarts = 0;
+  ShaderProgram cartProg;
+  ShaderProgram cartFramesProg;
+  if (gpuFrames)
+  {
+    cartProg = ShaderProgram(initShader("cart.vert", "fragment.glsl"));
+    cartFramesProg = ShaderProgram(initComputeShader("cartframes.comp"));
+    gpuCarts = new GpuCartFrames(*frameTable, cartFramesProg);
+
+    vector<mat4> gpuMatrices(train.cars());
+    computeCartFrames(*frameTable, &carArcLengths[0], train.cars(), &modelMatrices[0]);
+    gpuCarts->update(&carArcLengths[0], train.cars());
+    gpuCarts->readTransforms(&gpuMatrices[0], train.cars());
+
+    float maxError = 0.f;
+    for (int a = 0; a < train.cars(); a++)
+      for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+          maxError = std::max(maxError, abs(gpuMatrices[a][c][r] - modelMatrices[a][c][r]));
+    printf("GPU cart frames: largest difference from the CPU %g \n", maxError);
+    CheckGLErrors("gpuCarts");
+  }
+  delete frameTable;
+  frameTable = 0;
+
+  //With --trains above 1 the window runs a park spread evenly round the
+  //track. Jobs step, frame, cull and pack every car into an instance
+  //buffer, and this thread only uploads it and draws it in one call, with
+  //the supports' program as it takes its transforms the same way.
+  ParkFrame* parkFrame = 0;
+  JobSystem* parkJobs = 0;
+  GLuint park_vao = 0;
+  GLuint parkTransforms = 0;
+  if (options.trains > 1)
+  {
+    vector<Train> start;
+    for (int t = 0; t < options.trains; t++)
+    {
+      start.push_back(Train(profile, header.startArcLength + t * profile.trackLength() / options.trains,
+                            header.cars, header.coupling));
+    }
+    parkFrame = new ParkFrame(packedFrames, start, &telemetry);
+    parkJobs = new JobSystem(options.threads);
+    glGenVertexArrays(1, &park_vao);
+    glGenBuffers(1, &parkTransforms);
+    initInstancedVAO(park_vao, vbo, parkTransforms);
+    printf("%d trains, frames built by %d threads \n", options.trains, parkJobs->threads());
   }
 
+  typedef std::chrono::steady_clock Clock;
+  const double simDt = 1.0 / simRate;
+  double accumulator = 0.0;
+  Clock::time_point previousTime = Clock::now();
+
+  //Simulation and render rates are reported separately once a second
+  Clock::time_point reportTime = previousTime;
+  int simSteps = 0;
+  int frames = 0;
+  double simSeconds = 0.0;
+  double submitSeconds = 0.0;     //CPU time spent issuing the draws
+  double parkSeconds = 0.0;       //building the park's instances
+
+  //Position in the replay, and the first step that came out different
+  size_t replayFrame = 0;
+  size_t replayTick = 0;
+  size_t replayEvent = 0;
+  long long firstMismatch = -1;
+
     // run an event-triggered main loop
     while (!glfwWindowShouldClose(window))
     {
     glClearColor(0.7,0.7,0.7, 1);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);		//Clear color and depth buffers (Haven't covered yet)
-		glUseProgram(program);
-
-		loadUniforms(program, winRatio*perspectiveMatrix*cam.getMatrix(), mat4(1.f));
-
-        // call function to draw our scene
-        //render(vao, 0, indices.size());
-
-        renderCurve(curve_vao, curve_points.size());
-        renderCurve(curve2_vao, curve2_points.size());
-        renderCurve(curve3_vao, curve3_points.size());
-
-
-        //loadUniforms(beadProg, winRatio*perspectiveMatrix*cam.getMatrix(), mat4(1.f));
-
 
 
 
@@ -916,136 +1033,215 @@ int main(int argc, char *argv[])
 
 
 
-        //note vs = v * delta_t
 
+        //Run as many fixed steps as the elapsed time calls for
+        Clock::time_point now = Clock::now();
+        double frameTime = std::chrono::duration<double>(now - previousTime).count();
+        previousTime = now;
+        accumulator += std::min(frameTime, MAX_FRAME_TIME);
 
+        //A replay runs the steps the recorded frame did, whatever the clock says
+        int frameSteps = 0;
+        if (replay)
+        {
+          if (replayFrame < replay->frameSteps.size())
+            frameSteps = replay->frameSteps[replayFrame];
+          accumulator = 0.0;
+        } else
+        {
+          for (; accumulator >= simDt; accumulator -= simDt)
+            frameSteps++;
+        }
 
-        if (gravityFreeFall && ( (float) (i % curve_points.size())/ (float) curve_points.size()) > 0.60)
+        if (parkFrame)
         {
-          //std::cout << "Now in deacc_Stage stage \n";
-          gravityFreeFall = false;
-          deacc_Stage = true;
-          lifting_stage = false;
-          v_dec = sqrt( (2.0f * dot(GRAVITY , (H - beadPos)) + 1.f ));
-          l_dec = length(curve_points.at(i%curve_points.size()) - curve_points.at(curve_points.size() -1));
-        } else if (!gravityFreeFall && beadPos.y > (H.y - 0.5))
+          parkFrame->step(*parkJobs, frameSteps, simDt);
+          simSteps += frameSteps;
+          simTick += frameSteps;
+        }
+        for (int n = 0; n < frameSteps && !parkFrame; n++)
         {
-          //std::cout << "Now in gravity Free fall stage \n";
-          gravityFreeFall = true;
-          deacc_Stage = false;
-          lifting_stage = false;
-        } else if (deacc_Stage && (i == (curve_points.size() - 12)))
+          train.step(simDt);
+          simSteps++;
+          if (telemetry.isOpen())
+            telemetry.push(simTick, &train, 1);
+          simTick++;
+
+          uint32_t checksum = checksumTrain(train);
+          recorder.tick(checksum);
+          if (replay && firstMismatch < 0 &&
+              (replayTick >= replay->checksums.size() || checksum != replay->checksums[replayTick]))
+            firstMismatch = replayTick;
+          replayTick++;
+        }
+        simSeconds += std::chrono::duration<double>(Clock::now() - now).count();
+        frames++;
+
+        //Draw the train part way between the last two steps, every car
+        //from one batched frame lookup
+        float alpha = (float)(accumulator / simDt);
+        if (replay && replayFrame < replay->frameAlpha.size())
+          alpha = replay->frameAlpha[replayFrame];
+        recorder.frame(frameSteps, alpha);
+        train.carArcLengths(alpha, &carArcLengths[0]);
+        if (parkFrame)
         {
-          //std::cout << "Now in lifting stage \n";
-          gravityFreeFall = false;
-          deacc_Stage = false;
-          lifting_stage = true;
+          //the camera rides the first train
+          modelMatrices[0] = parkFrame->frontCar(alpha);
+        } else if (gpuCarts)
+        {
+          gpuCarts->update(&carArcLengths[0], train.cars());
+          //only the front car is needed on the CPU, for the camera
+          computeCartFrames(packedFrames, &carArcLengths[0], 1, &modelMatrices[0]);
+        } else
+        {
+          computeCartFrames(packedFrames, &carArcLengths[0], train.cars(), &modelMatrices[0]);
         }
 
+        if (isFirstPerson){
+        mat4 ModelMatrix = modelMatrices[0];
+        vec3 normalized_Normal_cart = vec3(ModelMatrix[1]);
+        activeCamera->pos = vec3(ModelMatrix[3]) + 0.75f * normalized_Normal_cart;
+        activeCamera->up = normalized_Normal_cart;
+        activeCamera->dir = vec3(ModelMatrix[2]);
+        activeCamera->right = vec3(ModelMatrix[0]);
+        }
 
-        double v;
-
-        //The velocity will change here..
-        if (gravityFreeFall)
+        //Everything is drawn after the camera has followed the train, from
+        //one view for the whole frame
+        mat4 viewProjection = winRatio * perspectiveMatrix * cam.getMatrix();
+        if (parkFrame)
         {
-        v = sqrt( (2.0f * dot(GRAVITY , (H - beadPos)) + 2.f ));
-      } else if (deacc_Stage)  {
-        v = v_dec * length(beadPos - curve_points.at(curve_points.size() -1))/(l_dec);
-      } else
-      {
-        v = v_dec;
-      }
-
-
-        double vs = v * 1.0f/60.0f;
-
-        ///
-        //vec3 arcLengthParameterization(vec3 bead_pos, int i, vector<vec3> points, double deltaS)
-        beadPos = arcLengthParameterization(beadPos,i , curve_points, vs);
-        //activeCamera->pos = beadPos + vec3(0,0.1,0);
-        beadPos_prev = curve_points.at( (i - 10) % curve_points.size());
-        beadPos_future = curve_points.at( (i + 10) % curve_points.size());
-
-        double x = calculate_x(beadPos_prev, beadPos ,beadPos_future);
-        double c = calculate_c(beadPos_prev, beadPos_future);
-
-        //Calcualating the radius of the curvature
-        double r = (pow(x, 2) + pow(c, 2))/(2 * x);
-        double k = 1.0f/r;
-
-        vec3 n = 1.0f/(length(beadPos_future - 2.0f * beadPos + beadPos_prev))
-                *  (beadPos_future - 2.0f * beadPos + beadPos_prev);
-
-
-        //Could change this to be simpler
-        vec3 acc_perpendicular = (float) k * n;
-        //Gravity is added in this case, since GRAVITY is positive
-        vec3 Normal_cart = +(acc_perpendicular + GRAVITY);
-
-        vec3 Tangent = beadPos_future - beadPos_prev;
-        vec3 T_tmp = normalize(Tangent);
+          Clock::time_point parkStart = Clock::now();
+          parkFrame->build(*parkJobs, alpha, viewProjection);
+          parkSeconds += std::chrono::duration<double>(Clock::now() - parkStart).count();
+        }
 
-        vec3 normalized_Normal_cart = normalize(Normal_cart);
+        Clock::time_point submitStart = Clock::now();
+        FrameUniforms frameUniforms;
+        frameUniforms.viewProjectionMatrix = viewProjection;
+        sceneUniforms.setFrame(frameUniforms);
 
-        vec3 B = cross(T_tmp, normalized_Normal_cart);
-        vec3 normalized_B = normalize(B);
+        program.use();
+        sceneUniforms.bindObject(0);
+        renderCurve(curve_vao, curve_points.size());
+        renderCurve(curve2_vao, curve2_points.size());
+        renderCurve(curve3_vao, curve3_points.size());
+        render(vao_plane, 0, plane_indices.size());
 
-        vec3 T = cross(normalized_Normal_cart, normalized_B);
-        vec3 T_hat = normalize(T);
-        mat4 ModelMatrix = mat4(vec4(normalized_B,0), vec4(normalized_Normal_cart,0),  vec4(T_hat,0), vec4(beadPos, 1));
-        mat4 ModelMatrix2 = mat4(vec4(normalized_B,0),vec4(normalized_Normal_cart,0), vec4(T_hat,0), vec4(beadPos- vec3(0.4, 0,0),1));
-        if (isFirstPerson){
-        activeCamera->pos = beadPos + 0.75f * normalized_Normal_cart;
-        activeCamera->up = normalized_Normal_cart;
-        activeCamera->dir = T_tmp;
-        activeCamera->right = normalized_B;
+        if (parkFrame)
+        {
+          glBindBuffer(GL_ARRAY_BUFFER, parkTransforms);
+          glBufferData(GL_ARRAY_BUFFER, sizeof(mat4) * parkFrame->visibleCount(), parkFrame->instances(),
+                       GL_STREAM_DRAW);
+          supportProg.use();
+          renderInstanced(park_vao, indices.size(), parkFrame->visibleCount());
+        } else if (gpuCarts)
+        {
+          cartProg.use();
+          renderInstanced(vao, indices.size(), gpuCarts->count());
+        } else
+        {
+          sceneUniforms.setObjects(1, &modelMatrices[0], train.cars());
+          for (int c = 0; c < train.cars(); c++)
+          {
+            sceneUniforms.bindObject(1 + c);
+            render(vao, 0, indices.size());
+          }
+          sceneUniforms.bindObject(0);
         }
 
-
-        //loadUniforms(program, winRatio*perspectiveMatrix*cam.getMatrix(), ModelMatrix);
-        //render(vao, 0, indices.size());
-
-        loadUniforms(program, winRatio * perspectiveMatrix * cam.getMatrix(), ModelMatrix);
-        render(vao, 0, indices.size());
-        /*
-        for (int l = 0; l <NUMCARTS;  l++)
+        if (!supports.empty())
         {
-          loadUniforms(program, winRatio*perspectiveMatrix*cam.getMatrix(), modelMatrices.at(0));
-          render(vao, 0, indices.size());
-        } */
-
-        //loadUniforms(program, winRatio*perspectiveMatrix*cam.getMatrix(), modelMatrices.at(0));
-        //render(vao, 0, indices.size());
-
-        modelMatrices.pop_back();
-        modelMatrices.push_back(ModelMatrix);
-        /*
-        loadUniforms(program, winRatio *perspectiveMatrix * cam.getMatrix(), modelMatrices.at(1));
-        render(vao, 0, indices.size());
-        loadUniforms(program, winRatio *perspectiveMatrix * cam.getMatrix(), modelMatrices.at(2));
-        render(vao, 0, indices.size());
-        */
-        loadUniforms(program, winRatio*perspectiveMatrix*cam.getMatrix(), mat4(1.f));
-        render(vao_plane, 0, plane_indices.size());
+          supportProg.use();
+          renderInstanced(support_vao, column_indices.size(), supports.size());
+        }
 
-        //renderBead(beadProg,beadPos, winRatio*perspectiveMatrix*cam.getMatrix(),mat4(1.f));
+        CheckGLErrors("render");
+        submitSeconds += std::chrono::duration<double>(Clock::now() - submitStart).count();
         //std::cout << "ds is " << vs << "\n";
-        i = i % curve_points.size();
         // scene is rendered to the back buffer, so swap to front for display
         glfwSwapBuffers(window);
         glfwSwapInterval(1);
 
         // sleep until next event before drawing again
         glfwPollEvents();
+
+        //Input recorded during this frame, then stop at the end of the replay
+        if (replay)
+        {
+          replayFrame++;
+          for (; replayEvent < replay->events.size() && replay->events[replayEvent].frame <= replayFrame; replayEvent++)
+            applyReplayEvent(replay->events[replayEvent]);
+
+          if (replayFrame >= replay->frameSteps.size())
+          {
+            if (firstMismatch >= 0)
+              printf("Replay DIVERGED at step %lld of %zu \n", firstMismatch, replay->checksums.size());
+            else
+              printf("Replay finished, all %zu steps match \n", replay->checksums.size());
+            glfwSetWindowShouldClose(window, GL_TRUE);
+          }
+        }
+
+        double reportSeconds = std::chrono::duration<double>(Clock::now() - reportTime).count();
+        if (reportSeconds >= 1.0)
+        {
+          printf("sim: %.0f steps/s at %.0f Hz (%.2f us/step), render: %.1f fps (%.1f us submitting) \n",
+                 simSteps / reportSeconds, simRate, 1e6 * simSeconds / std::max(simSteps, 1),
+                 frames / reportSeconds, 1e6 * submitSeconds / std::max(frames, 1));
+          if (parkFrame)
+            printf("park: %d of %d cars visible, %.2f ms a frame building them \n", parkFrame->visibleCount(),
+                   options.trains * header.cars, 1e3 * parkSeconds / std::max(frames, 1));
+          reportTime = Clock::now();
+          simSteps = 0;
+          frames = 0;
+          simSeconds = 0.0;
+          submitSeconds = 0.0;
+          parkSeconds = 0.0;
+        }
 	}
 
+  if (telemetry.isOpen())
+  {
+    bool ok = telemetry.close();
+    printf("%s %llu telemetry records to %s, %llu dropped \n", ok ? "Wrote" : "ERROR: failed writing",
+           (unsigned long long)telemetry.written(), options.telemetry.c_str(),
+           (unsigned long long)telemetry.dropped());
+  }
+  if (recorder.isOpen())
+  {
+    uint32_t ticks = recorder.tickCount();
+    if (recorder.close())
+      printf("Recorded %u steps to %s \n", ticks, recordFile.c_str());
+    else
+      printf("ERROR: failed writing %s \n", recordFile.c_str());
+  }
+
 	// clean up allocated resources before exit
 	glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(VertexBuffers::COUNT, vbo.id);
   glDeleteVertexArrays(1, &curve_vao);
   glDeleteBuffers(VertexBuffers::COUNT, curve_vbo.id);
-	glDeleteProgram(program);
-  glDeleteProgram(beadProg);
+  glDeleteVertexArrays(1, &support_vao);
+  glDeleteBuffers(VertexBuffers::COUNT, support_vbo.id);
+  glDeleteBuffers(1, &supportTransforms);
+  glDeleteProgram(supportProg.program());
+  if (parkFrame)
+  {
+    glDeleteVertexArrays(1, &park_vao);
+    glDeleteBuffers(1, &parkTransforms);
+    delete parkFrame;
+    delete parkJobs;
+  }
+	glDeleteProgram(program.program());
+  glDeleteProgram(beadProg.program());
+  delete gpuCarts;
+  if (gpuFrames)
+  {
+    glDeleteProgram(cartProg.program());
+    glDeleteProgram(cartFramesProg.program());
+  }
 
 
 	glfwDestroyWindow(window);
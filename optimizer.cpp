@@ -0,0 +1,329 @@
+#include "optimizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "forceprofile.h"
+#include "frametable.h"
+#include "sweep.h"
+#include "track.h"
+#include "trackquery.h"
+
+//Cost of every metre (or stall) outside the constraints, large enough that
+//no objective gain pays for breaking them
+const float OPTIMIZE_PENALTY = 100.f;
+
+//Parts of the track closer than this many clearances along it are
+//neighbours, not two parts that could hit each other
+const float CLEARANCE_ARC_FACTOR = 2.f;
+
+//Range the move size is kept in, as fractions of the starting step
+const float MIN_STEP_FRACTION = 1e-3f;
+const float MAX_STEP_FRACTION = 4.f;
+
+const char* objectiveName(OptimizeObjective objective)
+{
+  static const char* names[OBJECTIVE_COUNT] = { "peak-g", "jerk", "lap-time" };
+  return (objective >= 0 && objective < OBJECTIVE_COUNT) ? names[objective] : "unknown";
+}
+
+TrackScore evaluateTrack(const std::vector<vec3>& control, const std::vector<SegmentSpec>& specs,
+                         const OptimizeOptions& options)
+{
+  std::vector<vec3> points = control;
+  subdivideCurve(&points, CURVE_SUBDIVISIONS);
+  TrackSegments segments = specs.empty() ? TrackSegments(points, highestPoint(points))
+                                         : TrackSegments(points, specs);
+  VelocityProfile profile(points, segments);
+  FrameTable frames(points);
+  std::vector<ForceSample> samples;
+  computeForceProfile(points, profile, frames, &samples);
+
+  TrackScore score;
+  int size = points.size();
+  double jerk2 = 0.0;
+  score.peakG = 0.f;
+  score.peakJerk = 0.f;
+  score.minY = points[0].y;
+  score.maxY = points[0].y;
+  for (int k = 0; k < size; k++)
+  {
+    const ForceSample& f = samples[k];
+    float g = sqrt(f.gVertical * f.gVertical + f.gLateral * f.gLateral + f.gLongitudinal * f.gLongitudinal);
+    score.peakG = std::max(score.peakG, g);
+    score.peakJerk = std::max(score.peakJerk, f.jerk);
+    jerk2 += (double)f.jerk * f.jerk;
+    score.minY = std::min(score.minY, points[k].y);
+    score.maxY = std::max(score.maxY, points[k].y);
+  }
+  score.rmsJerk = sqrt(jerk2 / size);
+  score.lapTime = profile.lapTime();
+  score.stalls = profile.stopArcLength() >= 0.f && profile.stopStage() == STAGE_FREE_FALL;
+
+  //Closest approach of points that are far apart along the track, over a
+  //grid of cells the size of the clearance so only nearby cells are searched
+  TrackQuery grid(points, options.clearance);
+  score.clearance = grid.clearance(CLEARANCE_ARC_FACTOR * options.clearance);
+
+  score.violation = std::max(0.f, options.clearance - score.clearance) +
+                    std::max(0.f, options.minHeight - score.minY) +
+                    std::max(0.f, score.maxY - options.maxHeight) +
+                    std::max(0.f, score.peakG - options.maxG) +
+                    (score.stalls ? 1.f : 0.f);
+
+  float objective = score.peakG;
+  if (options.objective == OBJECTIVE_JERK)
+    objective = score.rmsJerk;
+  else if (options.objective == OBJECTIVE_LAP_TIME)
+    objective = fabs(score.lapTime - options.targetLapTime);
+  score.cost = objective + OPTIMIZE_PENALTY * score.violation;
+  return score;
+}
+
+//Moves control point i, keeping it within maxMove of origin[i]
+static void movePoint(std::vector<vec3>* control, int i, const std::vector<vec3>& origin, float maxMove,
+                      std::normal_distribution<float>* normal, std::mt19937_64* random)
+{
+  vec3 p = (*control)[i] + vec3((*normal)(*random), (*normal)(*random), (*normal)(*random));
+  vec3 d = p - origin[i];
+  float distance = length(d);
+  if (distance > maxMove)
+    p = origin[i] + d * (maxMove / distance);
+  (*control)[i] = p;
+}
+
+//Moves about two of the control points, and always at least one
+static void mutate(std::vector<vec3>* control, const std::vector<vec3>& origin, float maxMove, float step,
+                   std::mt19937_64* random)
+{
+  int n = control->size();
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+  std::normal_distribution<float> normal(0.f, step);
+  bool moved = false;
+  for (int i = 0; i < n; i++)
+  {
+    if (uniform(*random) * n < 2.f)
+    {
+      movePoint(control, i, origin, maxMove, &normal, random);
+      moved = true;
+    }
+  }
+  if (!moved)
+  {
+    movePoint(control, std::uniform_int_distribution<int>(0, n - 1)(*random), origin, maxMove, &normal, random);
+  }
+}
+
+OptimizeResult optimizeTrack(const std::vector<vec3>& control, const std::vector<SegmentSpec>& specs,
+                             const OptimizeOptions& options,
+                             std::function<void(const OptimizeResult&)> progress)
+{
+  OptimizeResult result;
+  result.control = control;
+  result.start = evaluateTrack(control, specs, options);
+  result.best = result.start;
+  result.evaluated = 1;
+  result.generations = 0;
+  result.improvements = 0;
+
+  int population = std::max(1, options.population);
+  int numThreads = options.threads;
+  if (numThreads <= 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  numThreads = std::min(numThreads, population);
+
+  std::vector<std::vector<vec3> > candidates(population);
+  std::vector<TrackScore> scores(population);
+  float step = options.step;
+
+  while (result.evaluated < options.candidates && !control.empty())
+  {
+    int count = (int)std::min<long long>(population, options.candidates - result.evaluated);
+    long long first = result.generations * population;
+    std::atomic<int> next(0);
+
+    auto work = [&]() {
+      for (int c = next++; c < count; c = next++)
+      {
+        std::mt19937_64 random(runSeed(options.seed, first + c));
+        candidates[c] = result.control;
+        mutate(&candidates[c], control, options.maxMove, step, &random);
+        scores[c] = evaluateTrack(candidates[c], specs, options);
+      }
+    };
+
+    //This thread takes a share too
+    std::vector<std::thread> workers;
+    for (int t = 1; t < std::min(numThreads, count); t++)
+    {
+      workers.push_back(std::thread(work));
+    }
+    work();
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+      workers[t].join();
+    }
+
+    //The first of equal candidates wins, whichever thread finished first
+    int best = 0;
+    for (int c = 1; c < count; c++)
+    {
+      if (scores[c].cost < scores[best].cost)
+        best = c;
+    }
+    if (scores[best].cost < result.best.cost)
+    {
+      result.control.swap(candidates[best]);
+      result.best = scores[best];
+      result.improvements++;
+      step = std::min(step * 1.5f, options.step * MAX_STEP_FRACTION);
+    } else
+    {
+      step = std::max(step * 0.9f, options.step * MIN_STEP_FRACTION);
+    }
+
+    result.evaluated += count;
+    result.generations++;
+    if (progress)
+      progress(result);
+  }
+
+  return result;
+}
+
+//One line of a track's scores for runOptimizeHeadless
+static void printScore(const char* label, const TrackScore& score)
+{
+  printf("%-17s peak %.2f g, jerk rms %.1f peak %.1f g/s, lap %.2f s, clearance %.2f m, height %.2f to %.2f m%s%s \n",
+         label, score.peakG, score.rmsJerk, score.peakJerk, score.lapTime, score.clearance, score.minY, score.maxY,
+         score.stalls ? ", STALLS" : "", score.violation > 0.f ? ", OUTSIDE LIMITS" : "");
+}
+
+bool parseOptimizeOption(int argc, char** argv, int* a, OptimizeOptions* options)
+{
+  const char* value;
+  if ((value = optionValue(argc, argv, a, "--optimize")))
+    options->candidates = atoll(value);
+  else if ((value = optionValue(argc, argv, a, "--objective")))
+  {
+    int objective = 0;
+    while (objective < OBJECTIVE_COUNT && strcmp(value, objectiveName((OptimizeObjective)objective)) != 0)
+      objective++;
+    options->objective = (OptimizeObjective)objective;
+  }
+  else if ((value = optionValue(argc, argv, a, "--target-lap")))
+    options->targetLapTime = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--clearance")))
+    options->clearance = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--min-height")))
+    options->minHeight = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--max-height")))
+    options->maxHeight = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--max-move")))
+    options->maxMove = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--max-g")))
+    options->maxG = atof(value);
+  else if ((value = optionValue(argc, argv, a, "--out")))
+    options->out = value;
+  else
+    return false;
+  return true;
+}
+
+int runOptimizeHeadless(const HeadlessOptions& options, const OptimizeOptions& optimizeOptions)
+{
+  if (optimizeOptions.objective == OBJECTIVE_COUNT)
+  {
+    printf("ERROR: --objective must be peak-g, jerk or lap-time \n");
+    return -1;
+  }
+
+  std::vector<vec3> control;
+  std::vector<SegmentSpec> specs;
+  try
+  {
+    loadControlPoints(&control, options.track, false);
+    specs = readSegmentSpecs(options.track);
+  } catch (const std::exception& e)
+  {
+    printf("ERROR: %s: %s \n", options.track.c_str(), e.what());
+    return -1;
+  }
+  if (control.size() < 2)
+  {
+    printf("ERROR: track %s has no points \n", options.track.c_str());
+    return -1;
+  }
+
+  //Unless told otherwise the track stays within the heights it has now
+  std::vector<vec3> curve = control;
+  subdivideCurve(&curve, CURVE_SUBDIVISIONS);
+  float lowest = curve[0].y, highest = curve[0].y;
+  for (size_t k = 0; k < curve.size(); k++)
+  {
+    lowest = std::min(lowest, curve[k].y);
+    highest = std::max(highest, curve[k].y);
+  }
+
+  OptimizeOptions optimize = optimizeOptions;
+  if (std::isnan(optimize.minHeight))
+    optimize.minHeight = lowest;
+  if (std::isnan(optimize.maxHeight))
+    optimize.maxHeight = highest;
+  optimize.threads = options.threads;
+  optimize.seed = options.seed;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Clock::time_point lastReport = start;
+  OptimizeResult result = optimizeTrack(control, specs, optimize, [&](const OptimizeResult& sofar) {
+    Clock::time_point now = Clock::now();
+    if (std::chrono::duration<double>(now - lastReport).count() < 1.0)
+      return;
+    lastReport = now;
+    printf("%lld tracks: cost %.4f, %lld improvements \n", sofar.evaluated, sofar.best.cost, sofar.improvements);
+    fflush(stdout);
+  });
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::string out = optimize.out.empty() ? options.track + ".opt.con" : optimize.out;
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < specs.size(); i++)
+  {
+    lines.push_back(segmentSpecLine(specs[i]));
+  }
+  if (!saveControlPoints(result.control, out, lines))
+  {
+    printf("ERROR: unable to write %s \n", out.c_str());
+    return -1;
+  }
+
+  float moved = 0.f;
+  for (size_t i = 0; i < control.size(); i++)
+  {
+    moved = std::max(moved, length(result.control[i] - control[i]));
+  }
+
+  printf("track:            %s (%d control points), objective %s", options.track.c_str(), (int)control.size(),
+         objectiveName(optimize.objective));
+  if (optimize.objective == OBJECTIVE_LAP_TIME)
+    printf(" %.2f s", optimize.targetLapTime);
+  printf(" \n");
+  printf("limits:           clearance %.2f m, height %.2f to %.2f m, peak %.1f g, control points move up to %.2f m \n",
+         optimize.clearance, optimize.minHeight, optimize.maxHeight, optimize.maxG, optimize.maxMove);
+  printf("search:           %lld tracks in %.2f s (%.0f tracks/s), %lld generations, %lld improvements, seed %llu \n",
+         result.evaluated, wallSeconds, result.evaluated / wallSeconds, result.generations, result.improvements,
+         options.seed);
+  printScore("original:", result.start);
+  printScore("optimized:", result.best);
+  printf("written:          %s, control points moved %.2f m at most \n", out.c_str(), moved);
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "headless.h"
+#include "tracksegments.h"
+
+using namespace glm;
+
+//What the optimizer tries to make smaller
+enum OptimizeObjective {
+  OBJECTIVE_PEAK_G = 0,     //largest total g anywhere on the lap
+  OBJECTIVE_JERK,           //root mean square jerk over the lap
+  OBJECTIVE_LAP_TIME,       //distance of the lap time from targetLapTime
+  OBJECTIVE_COUNT
+};
+
+//Name used on the command line and in reports
+const char* objectiveName(OptimizeObjective objective);
+
+//Settings for optimizeTrack. Lengths are in the curve's metres, not the
+//units of the .con file.
+struct OptimizeOptions {
+  OptimizeObjective objective;
+  float targetLapTime;      //seconds, for OBJECTIVE_LAP_TIME
+  float clearance;          //closest two parts of the track can come, away from each other along it
+  float minHeight;          //lowest and highest the curve may go
+  float maxHeight;
+  float maxMove;            //furthest a control point may go from where it started
+  float maxG;               //limit on the peak g, whatever the objective
+  float step;               //starting size of the moves, metres
+  long long candidates;     //tracks to evaluate
+  int population;           //candidates tried from the best track each generation
+  int threads;              //0 uses one per core
+  unsigned long long seed;
+  std::string out;          //where runOptimizeHeadless writes the track, empty for the track's name + .opt.con
+
+  OptimizeOptions(): objective(OBJECTIVE_PEAK_G), targetLapTime(10.f), clearance(1.f), minHeight(0.f),
+                     maxHeight(10.f), maxMove(0.5f), maxG(5.f), step(0.1f), candidates(100000), population(64), threads(0),
+                     seed(1) {}
+};
+
+//How a track does, from its control points
+struct TrackScore {
+  float peakG;
+  float rmsJerk;            //g per second
+  float peakJerk;
+  float lapTime;
+  float clearance;          //closest approach of two parts of the track
+  float minY, maxY;
+  bool stalls;              //comes to rest before getting round
+  float violation;          //how far outside the constraints, 0 when it meets them all
+  float cost;               //objective plus a penalty on the violation, smaller is better
+};
+
+//Runs control points through the same pipeline as the ride (subdivision,
+//segments, velocity profile, frames and forces) and scores the result.
+//specs are the segment lines of the track file, empty to work them out
+//from the shape.
+TrackScore evaluateTrack(const std::vector<vec3>& control, const std::vector<SegmentSpec>& specs,
+                         const OptimizeOptions& options);
+
+struct OptimizeResult {
+  std::vector<vec3> control;  //best control points found
+  TrackScore start;
+  TrackScore best;
+  long long evaluated;
+  long long generations;
+  long long improvements;
+};
+
+//Moves the control points, each within options.maxMove of where it
+//started, to lower the cost with a (1 + population)
+//evolution strategy: every generation tries population random moves of
+//the best track so far in parallel, keeps the best if it is better, and
+//grows or shrinks the moves by whether it was. Candidate c of generation
+//g always draws from the same seed, so the result doesn't depend on the
+//number of threads. progress, if set, is called after every generation.
+OptimizeResult optimizeTrack(const std::vector<vec3>& control, const std::vector<SegmentSpec>& specs,
+                             const OptimizeOptions& options,
+                             std::function<void(const OptimizeResult&)> progress = nullptr);
+
+//Reads --optimize and the optimizer's limits, see parseRunOption.
+//--objective names it doesn't know leave objective at OBJECTIVE_COUNT.
+bool parseOptimizeOption(int argc, char** argv, int* a, OptimizeOptions* options);
+
+//Optimizes the control points of options.track for optimize.objective
+//within its limits, trying optimize.candidates tracks over
+//options.threads threads, writes the best to optimize.out and prints how
+//it compares with the original. NaN heights keep the track's own range.
+int runOptimizeHeadless(const HeadlessOptions& options, const OptimizeOptions& optimize);
+
+#endif
@@ -0,0 +1,81 @@
+#include "packedframes.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float QUAT_COMPONENT_RANGE = 0.70710678f;   //1/sqrt(2)
+
+uint64_t packQuat(quat q, int bits)
+{
+  float c[4] = { q.x, q.y, q.z, q.w };
+
+  int largest = 0;
+  for (int i = 1; i < 4; i++)
+  {
+    if (fabs(c[i]) > fabs(c[largest]))
+    {
+      largest = i;
+    }
+  }
+  float sign = (c[largest] < 0.f) ? -1.f : 1.f;
+
+  uint64_t maxValue = (1u << bits) - 1;
+  uint64_t packed = (uint64_t)largest << (3 * bits);
+  int shift = 2 * bits;
+  for (int i = 0; i < 4; i++)
+  {
+    if (i == largest)
+      continue;
+    float unit = (sign * c[i] / QUAT_COMPONENT_RANGE + 1.f) * 0.5f;
+    unit = std::min(std::max(unit, 0.f), 1.f);
+    packed |= (uint64_t)(unit * maxValue + 0.5f) << shift;
+    shift -= bits;
+  }
+  return packed;
+}
+
+quat unpackQuat(uint64_t packed, int bits)
+{
+  uint64_t maxValue = (1u << bits) - 1;
+  int largest = (int)(packed >> (3 * bits)) & 3;
+
+  float c[4];
+  float sum = 0.f;
+  int shift = 2 * bits;
+  for (int i = 0; i < 4; i++)
+  {
+    if (i == largest)
+      continue;
+    float unit = (float)((packed >> shift) & maxValue) / maxValue;
+    c[i] = (unit * 2.f - 1.f) * QUAT_COMPONENT_RANGE;
+    sum += c[i] * c[i];
+    shift -= bits;
+  }
+  c[largest] = sqrt(std::max(0.f, 1.f - sum));
+
+  return quat(c[3], c[0], c[1], c[2]);
+}
+
+PackedFrameTable::PackedFrameTable(const FrameTable& frames):
+  index(frames.arcLengths())
+{
+  for (int k = 0; k < frames.size(); k++)
+  {
+    position.push_back(frames.samplePosition(k));
+    orientation.push_back(packQuat10(frames.sampleOrientation(k)));
+  }
+}
+
+mat4 PackedFrameTable::modelMatrix(float s) const
+{
+  float t;
+  int k = sampleAt(s, &t);
+  int next = (k + 1) % position.size();
+  quat a = sampleOrientation(k);
+  quat b = sampleOrientation(next);
+  if (dot(a, b) < 0.f)
+  {
+    b = -b;
+  }
+  return frameMatrix(normalize(a * (1.f - t) + b * t), mix(position[k], position[next], t));
+}
@@ -0,0 +1,52 @@
+#ifndef PACKEDFRAMES_H
+#define PACKEDFRAMES_H
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <stdint.h>
+#include <vector>
+
+#include "arclengthindex.h"
+#include "frametable.h"
+
+using namespace glm;
+
+//Smallest three quaternion packing. The largest component is dropped (and
+//made positive, since q and -q are the same rotation), its index goes in
+//the top two bits, and the other three are quantized to bits each over
+//[-1/sqrt(2), 1/sqrt(2)].
+uint64_t packQuat(quat q, int bits);
+quat unpackQuat(uint64_t packed, int bits);
+
+//One 32 bit word per orientation
+inline uint32_t packQuat10(quat q) { return (uint32_t)packQuat(q, 10); }
+inline quat unpackQuat10(uint32_t packed) { return unpackQuat(packed, 10); }
+
+//50 of 64 bits, for when 10 bits is not accurate enough
+inline uint64_t packQuat16(quat q) { return packQuat(q, 16); }
+inline quat unpackQuat16(uint64_t packed) { return unpackQuat(packed, 16); }
+
+//A FrameTable with each orientation packed into 10 bits per component.
+//Positions are kept at full precision, separately.
+class PackedFrameTable {
+public:
+  PackedFrameTable(const FrameTable& frames);
+
+  mat4 modelMatrix(float s) const;
+
+  int size() const { return index.size(); }
+  int sampleAt(float s, float* t) const { return index.sampleAt(s, t); }
+  vec3 samplePosition(int k) const { return position[k]; }
+  uint32_t packedOrientation(int k) const { return orientation[k]; }
+  quat sampleOrientation(int k) const { return unpackQuat10(orientation[k]); }
+
+  //Memory used by the position and orientation tables
+  size_t bytes() const { return position.size() * sizeof(vec3) + orientation.size() * sizeof(uint32_t); }
+
+private:
+  ArcLengthIndex index;
+  std::vector<vec3> position;
+  std::vector<uint32_t> orientation;
+};
+
+#endif
@@ -0,0 +1,420 @@
+#include "parkcluster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "blocksystem.h"
+#include "socketio.h"
+#include "train.h"
+
+//Largest payload either side accepts, to catch a corrupt stream
+const uint32_t CLUSTER_MAX_MESSAGE = 1u << 30;
+
+static bool sendMessage(int fd, uint32_t type, const void* payload, size_t size)
+{
+  ClusterMessage m;
+  m.type = type;
+  m.size = size;
+  return writeAll(fd, &m, sizeof(m)) && writeAll(fd, payload, size);
+}
+
+static bool receiveMessage(int fd, ClusterMessage* m, std::vector<unsigned char>* payload)
+{
+  if (!readAll(fd, m, sizeof(*m)) || m->size > CLUSTER_MAX_MESSAGE)
+    return false;
+  payload->resize(std::max<uint32_t>(m->size, 1));
+  return readAll(fd, &(*payload)[0], m->size);
+}
+
+static int workerError(int fd, const std::string& message)
+{
+  sendMessage(fd, CLUSTER_ERROR, message.data(), message.size());
+  return 1;
+}
+
+int runClusterWorker(int fd)
+{
+  ClusterMessage m;
+  std::vector<unsigned char> payload;
+  if (!receiveMessage(fd, &m, &payload) || m.type != CLUSTER_ASSIGN || m.size < sizeof(ClusterAssign))
+    return workerError(fd, "expected an assignment");
+
+  ClusterAssign assign;
+  memcpy(&assign, &payload[0], sizeof(assign));
+  std::vector<std::string> files;
+  size_t at = sizeof(assign);
+  for (uint32_t c = 0; c < assign.circuits; c++)
+  {
+    uint32_t length;
+    if (at + sizeof(length) > m.size)
+      return workerError(fd, "truncated assignment");
+    memcpy(&length, &payload[at], sizeof(length));
+    at += sizeof(length);
+    if (at + length > m.size)
+      return workerError(fd, "truncated assignment");
+    files.push_back(std::string((const char*)&payload[at], length));
+    at += length;
+  }
+
+  //One profile per file, shared by all of its circuits. The BlockSystem
+  //keeps pointers to them, so the vector must not grow after this.
+  std::vector<VelocityProfile> profiles;
+  std::map<std::string, int> profileOf;
+  profiles.reserve(files.size());
+  BlockSystem blocks;
+  float trainLength = assign.cars * CAR_COUPLING;
+  try
+  {
+    for (size_t c = 0; c < files.size(); c++)
+    {
+      if (profileOf.find(files[c]) == profileOf.end())
+      {
+        std::vector<vec3> points;
+        TrackSegments segments;
+        if (!loadTrack(files[c], &points, &segments))
+          return workerError(fd, "unable to load " + files[c]);
+        profileOf[files[c]] = profiles.size();
+        profiles.push_back(VelocityProfile(points, segments));
+      }
+      const VelocityProfile& profile = profiles[profileOf[files[c]]];
+      int track = blocks.addTrack(profile, assign.blocks);
+      float start = profile.sampleArcLength(profile.trackSegments().start());
+      for (int t = 0; t < assign.trains; t++)
+      {
+        if (blocks.addTrain(track, start + t * profile.trackLength() / assign.trains, trainLength) < 0)
+          return workerError(fd, "trains don't fit in the blocks of " + files[c]);
+      }
+    }
+  } catch (const std::exception& e)
+  {
+    return workerError(fd, e.what());
+  }
+
+  uint32_t count = blocks.numTrains();
+  if (!sendMessage(fd, CLUSTER_READY, &count, sizeof(count)))
+    return 1;
+
+  typedef std::chrono::steady_clock Clock;
+  std::vector<ClusterTrain> state(std::max<uint32_t>(count, 1));
+  double dt = 1.0 / assign.simRate;
+  double busySeconds = 0.0;
+  while (receiveMessage(fd, &m, &payload))
+  {
+    if (m.type == CLUSTER_DONE)
+    {
+      ClusterWorkerStats stats;
+      stats.busySeconds = busySeconds;
+      stats.holds = blocks.holds();
+      stats.heldSeconds = blocks.heldSeconds();
+      return sendMessage(fd, CLUSTER_STATS, &stats, sizeof(stats)) ? 0 : 1;
+    }
+    if (m.type != CLUSTER_STEP || m.size != sizeof(uint32_t))
+      return workerError(fd, "unexpected message");
+
+    uint32_t steps;
+    memcpy(&steps, &payload[0], sizeof(steps));
+    Clock::time_point start = Clock::now();
+    for (uint32_t n = 0; n < steps; n++)
+    {
+      blocks.step(dt);
+    }
+    for (uint32_t t = 0; t < count; t++)
+    {
+      state[t].arcLength = blocks.arcLength(t);
+      state[t].laps = blocks.laps(t);
+      state[t].held = blocks.isHeld(t);
+      state[t].circuit = blocks.trackOf(t);
+    }
+    busySeconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (!sendMessage(fd, CLUSTER_STATE, &state[0], count * sizeof(ClusterTrain)))
+      return 1;
+  }
+  return 1;
+}
+
+//The worker connections, closed and the forked workers reaped however
+//runCluster leaves
+struct WorkerSet {
+  std::vector<int> fds;
+  std::vector<pid_t> pids;
+
+  ~WorkerSet()
+  {
+    for (size_t w = 0; w < fds.size(); w++)
+      close(fds[w]);
+    for (size_t w = 0; w < pids.size(); w++)
+      waitpid(pids[w], 0, 0);
+  }
+};
+
+static void forkWorkers(int count, WorkerSet* workers)
+{
+  //Anything still buffered would be written again by every child
+  fflush(stdout);
+  for (int w = 0; w < count; w++)
+  {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+      throw std::runtime_error("unable to create a socket pair");
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+      close(sv[0]);
+      close(sv[1]);
+      throw std::runtime_error("unable to fork a worker");
+    }
+    if (pid == 0)
+    {
+      close(sv[0]);
+      for (size_t f = 0; f < workers->fds.size(); f++)
+        close(workers->fds[f]);
+      _exit(runClusterWorker(sv[1]));
+    }
+    close(sv[1]);
+    workers->fds.push_back(sv[0]);
+    workers->pids.push_back(pid);
+  }
+}
+
+static void acceptWorkers(int count, int port, WorkerSet* workers)
+{
+  int listener = listenTcp(port, count);
+  if (listener < 0)
+    throw std::runtime_error("unable to listen on the port");
+
+  printf("waiting for %d workers on port %d \n", count, port);
+  fflush(stdout);
+  while ((int)workers->fds.size() < count)
+  {
+    int fd = acceptTcp(listener);
+    if (fd < 0)
+    {
+      close(listener);
+      throw std::runtime_error("unable to accept a worker");
+    }
+    workers->fds.push_back(fd);
+  }
+  close(listener);
+}
+
+//Waits for a message of the given type from worker w, passing on its error
+static void expectMessage(const WorkerSet& workers, int w, uint32_t type, ClusterMessage* m,
+                          std::vector<unsigned char>* payload)
+{
+  if (!receiveMessage(workers.fds[w], m, payload))
+    throw std::runtime_error("lost worker " + std::to_string(w));
+  if (m->type == CLUSTER_ERROR)
+    throw std::runtime_error("worker " + std::to_string(w) + ": " +
+                             std::string((const char*)&(*payload)[0], m->size));
+  if (m->type != type)
+    throw std::runtime_error("unexpected message from worker " + std::to_string(w));
+}
+
+ClusterStats runCluster(const ClusterOptions& options)
+{
+  std::vector<std::string> circuits;
+  for (size_t f = 0; f < options.tracks.size(); f++)
+    for (int c = 0; c < options.copies; c++)
+      circuits.push_back(options.tracks[f]);
+  if (circuits.empty() || options.workers < 1)
+    throw std::runtime_error("nothing to run");
+
+  int numWorkers = std::min<int>(options.workers, circuits.size());
+
+  //A worker that dies shows up as a failed read, not as a signal
+  signal(SIGPIPE, SIG_IGN);
+  WorkerSet workers;
+  if (options.listenPort > 0)
+    acceptWorkers(numWorkers, options.listenPort, &workers);
+  else
+    forkWorkers(numWorkers, &workers);
+
+  //Circuits are dealt out in turn so every worker gets a mix of the tracks
+  for (int w = 0; w < numWorkers; w++)
+  {
+    std::vector<unsigned char> message(sizeof(ClusterAssign));
+    ClusterAssign assign;
+    assign.simRate = options.simRate;
+    assign.trains = options.trains;
+    assign.cars = options.cars;
+    assign.blocks = options.blocks;
+    assign.circuits = 0;
+    for (size_t c = w; c < circuits.size(); c += numWorkers)
+    {
+      uint32_t length = circuits[c].size();
+      const unsigned char* bytes = (const unsigned char*)&length;
+      message.insert(message.end(), bytes, bytes + sizeof(length));
+      message.insert(message.end(), circuits[c].begin(), circuits[c].end());
+      assign.circuits++;
+    }
+    memcpy(&message[0], &assign, sizeof(assign));
+    if (!sendMessage(workers.fds[w], CLUSTER_ASSIGN, &message[0], message.size()))
+      throw std::runtime_error("lost worker " + std::to_string(w));
+  }
+
+  //Every worker's trains go in one slice of the park array
+  ClusterMessage m;
+  std::vector<unsigned char> payload;
+  std::vector<size_t> first(numWorkers + 1, 0);
+  for (int w = 0; w < numWorkers; w++)
+  {
+    expectMessage(workers, w, CLUSTER_READY, &m, &payload);
+    uint32_t count;
+    memcpy(&count, &payload[0], sizeof(count));
+    first[w + 1] = first[w] + count;
+  }
+  std::vector<ClusterTrain> park(std::max<size_t>(first[numWorkers], 1));
+
+  ClusterStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.workers = numWorkers;
+  stats.circuits = circuits.size();
+  stats.trains = first[numWorkers];
+
+  long long steps = (long long)(options.seconds * options.simRate);
+  long long perExchange = std::max(1LL, (long long)(options.simRate / std::max(options.exchangeRate, 1)));
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (long long done = 0; done < steps; done += perExchange)
+  {
+    Clock::time_point exchangeStart = Clock::now();
+    uint32_t n = std::min(perExchange, steps - done);
+    for (int w = 0; w < numWorkers; w++)
+    {
+      if (!sendMessage(workers.fds[w], CLUSTER_STEP, &n, sizeof(n)))
+        throw std::runtime_error("lost worker " + std::to_string(w));
+    }
+
+    //The workers step at the same time, then are merged in order
+    for (int w = 0; w < numWorkers; w++)
+    {
+      expectMessage(workers, w, CLUSTER_STATE, &m, &payload);
+      size_t count = first[w + 1] - first[w];
+      if (m.size != count * sizeof(ClusterTrain))
+        throw std::runtime_error("bad state from worker " + std::to_string(w));
+      Clock::time_point mergeStart = Clock::now();
+      memcpy(&park[first[w]], &payload[0], m.size);
+      stats.mergeSeconds += std::chrono::duration<double>(Clock::now() - mergeStart).count();
+      stats.bytesReceived += sizeof(m) + m.size;
+    }
+    stats.exchanges++;
+    stats.worstExchange = std::max(stats.worstExchange,
+                                   std::chrono::duration<double>(Clock::now() - exchangeStart).count());
+  }
+  stats.wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  for (int w = 0; w < numWorkers; w++)
+  {
+    if (!sendMessage(workers.fds[w], CLUSTER_DONE, 0, 0))
+      throw std::runtime_error("lost worker " + std::to_string(w));
+    expectMessage(workers, w, CLUSTER_STATS, &m, &payload);
+    ClusterWorkerStats worker;
+    memcpy(&worker, &payload[0], sizeof(worker));
+    stats.maxBusySeconds = std::max(stats.maxBusySeconds, worker.busySeconds);
+    stats.holds += worker.holds;
+    stats.heldSeconds += worker.heldSeconds;
+  }
+
+  for (int t = 0; t < stats.trains; t++)
+  {
+    stats.laps += park[t].laps;
+    stats.heldAtEnd += park[t].held;
+  }
+  return stats;
+}
+
+bool parseClusterOption(int argc, char** argv, int* a, ClusterOptions* options)
+{
+  const char* value;
+  if ((value = optionValue(argc, argv, a, "--workers")))
+    options->workers = atoi(value);
+  else if ((value = optionValue(argc, argv, a, "--listen")))
+    options->listenPort = atoi(value);
+  else if (strcmp(argv[*a], "--scaling") == 0)
+    options->scaling = true;
+  else
+    return false;
+  return true;
+}
+
+int runClusterHeadless(const HeadlessOptions& options, const ClusterOptions& clusterOptions)
+{
+  if (!checkRunOptions(options, CHECK_RUN | CHECK_CARS | CHECK_COPIES | CHECK_BLOCKS))
+    return -1;
+  if (clusterOptions.workers < 1)
+  {
+    printf("ERROR: --workers must be positive \n");
+    return -1;
+  }
+
+  ClusterOptions cluster = clusterOptions;
+  cluster.tracks = options.tracks;
+  if (cluster.tracks.empty())
+    cluster.tracks.push_back(options.track);
+  cluster.copies = options.copies;
+  cluster.trains = options.trains;
+  cluster.cars = options.cars;
+  cluster.blocks = options.blocks;
+  cluster.simRate = options.simRate;
+  cluster.seconds = options.seconds;
+
+  //Remote workers serve a single run, so only forked ones can be rerun
+  std::vector<int> counts;
+  for (int w = 1; cluster.scaling && cluster.listenPort == 0 && w < clusterOptions.workers; w *= 2)
+    counts.push_back(w);
+  counts.push_back(clusterOptions.workers);
+
+  printf("park:             %d circuits (%d files x %d copies), %d trains of %d cars each, %d blocks \n",
+         (int)cluster.tracks.size() * options.copies, (int)cluster.tracks.size(), options.copies,
+         options.trains, options.cars, options.blocks);
+  printf("simulated:        %.1f s at %.0f Hz, merged %d times a second over %s \n", options.seconds,
+         options.simRate, cluster.exchangeRate, cluster.listenPort > 0 ? "TCP" : "Unix sockets");
+  printf("\n%8s %10s %14s %8s %10s %12s %12s %10s \n", "workers", "wall (s)", "train-steps/s", "speedup",
+         "busiest", "merge (us)", "worst (ms)", "MB/s in");
+
+  double baseSeconds = 0.0;
+  ClusterStats stats;
+  memset(&stats, 0, sizeof(stats));
+  for (size_t c = 0; c < counts.size(); c++)
+  {
+    cluster.workers = counts[c];
+    try
+    {
+      stats = runCluster(cluster);
+    } catch (const std::exception& e)
+    {
+      printf("ERROR: %s \n", e.what());
+      return -1;
+    }
+    //Speedup is against one worker, so it is only known when that ran
+    if (stats.workers == 1)
+      baseSeconds = stats.wallSeconds;
+
+    double trainSteps = (double)stats.trains * (long long)(options.seconds * options.simRate);
+    char speedup[32] = "-";
+    if (baseSeconds > 0.0)
+      snprintf(speedup, sizeof(speedup), "%.2fx", baseSeconds / stats.wallSeconds);
+    printf("%8d %10.3f %14.3g %8s %9.3fs %12.1f %12.2f %10.1f \n", stats.workers, stats.wallSeconds,
+           trainSteps / stats.wallSeconds, speedup, stats.maxBusySeconds,
+           1e6 * stats.mergeSeconds / stats.exchanges, 1e3 * stats.worstExchange,
+           stats.bytesReceived / 1048576.0 / stats.wallSeconds);
+  }
+
+  double trainSeconds = options.seconds * stats.trains;
+  printf("\ntrains:           %d, %lld laps, %lld holds, %.2f%% of train time waiting, %d waiting at the end \n",
+         stats.trains, stats.laps, stats.holds, 100.0 * stats.heldSeconds / trainSeconds, stats.heldAtEnd);
+  printf("peak memory:      %.1f MB in the coordinator \n", peakMemoryMB());
+
+  return 0;
+}
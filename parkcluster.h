@@ -0,0 +1,110 @@
+#ifndef PARKCLUSTER_H
+#define PARKCLUSTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "headless.h"
+
+//A park too big for one process: a coordinator shards the circuits over
+//worker processes, each of which steps its circuits with a BlockSystem.
+//Every exchange the coordinator tells all workers how many steps to run,
+//and they send back the state of their trains, which it merges into one
+//array for the whole park. Workers are forked locally over Unix sockets
+//or connect over TCP from other machines.
+//
+//Every message is a ClusterMessage followed by size bytes of payload, in
+//the native byte order, so workers have to run on the same architecture.
+enum ClusterMessageType {
+  CLUSTER_ASSIGN = 1,   //coordinator: ClusterAssign, then per circuit uint32 length and the track path
+  CLUSTER_READY,        //worker: uint32 trains it runs
+  CLUSTER_STEP,         //coordinator: uint32 steps to run
+  CLUSTER_STATE,        //worker: ClusterTrain for each of its trains
+  CLUSTER_DONE,         //coordinator: no payload
+  CLUSTER_STATS,        //worker: ClusterWorkerStats
+  CLUSTER_ERROR         //worker: the message text
+};
+
+struct ClusterMessage {
+  uint32_t type;
+  uint32_t size;
+};
+
+struct ClusterAssign {
+  double simRate;
+  int32_t trains;           //per circuit
+  int32_t cars;
+  int32_t blocks;           //per circuit
+  uint32_t circuits;
+};
+
+//What the coordinator sees of each train, 12 bytes
+struct ClusterTrain {
+  float arcLength;
+  uint32_t laps;
+  uint8_t held;
+  uint8_t circuit;          //index among the worker's circuits, mod 256
+  uint16_t padding;
+};
+
+struct ClusterWorkerStats {
+  double busySeconds;       //time spent stepping
+  int64_t holds;
+  double heldSeconds;
+};
+
+//Settings for runCluster
+struct ClusterOptions {
+  std::vector<std::string> tracks;
+  int copies;               //circuits built from each track file
+  int trains;               //per circuit
+  int cars;
+  int blocks;               //per circuit
+  double simRate;
+  double seconds;
+  int workers;
+  int exchangeRate;         //merges per simulated second
+  int listenPort;           //0 forks local workers, otherwise waits for them on this TCP port
+  bool scaling;             //runClusterHeadless reruns with 1, 2, 4 ... workers
+
+  ClusterOptions(): copies(1), trains(1), cars(1), blocks(12), simRate(240.0), seconds(60.0), workers(1),
+                    exchangeRate(60), listenPort(0), scaling(false) {}
+};
+
+struct ClusterStats {
+  int workers;
+  int circuits;
+  int trains;
+  long long exchanges;
+  double wallSeconds;
+  double mergeSeconds;      //coordinator time copying worker state into the park array
+  double worstExchange;     //longest step and merge round
+  double maxBusySeconds;    //the busiest worker's stepping time
+  long long laps;
+  long long holds;
+  double heldSeconds;
+  int heldAtEnd;
+  double bytesReceived;
+};
+
+//Runs the park across options.workers workers. Throws std::runtime_error
+//if a worker can't be started or fails.
+ClusterStats runCluster(const ClusterOptions& options);
+
+//Serves one coordinator on a connected socket until it is done, for
+//remote workers connected with connectTcp. Returns the process exit code.
+int runClusterWorker(int fd);
+
+//Reads --workers, --listen and --scaling, see parseRunOption
+bool parseClusterOption(int argc, char** argv, int* a, ClusterOptions* options);
+
+//Shards options.copies circuits of every track over cluster.workers
+//processes, each running options.trains trains per circuit with
+//options.blocks blocks, and prints the throughput and the cost of merging
+//their state every display frame. With cluster.scaling it runs with 1, 2,
+//4 ... forked workers up to cluster.workers and prints the speedup of
+//each.
+int runClusterHeadless(const HeadlessOptions& options, const ClusterOptions& cluster);
+
+#endif
@@ -0,0 +1,209 @@
+#include "parksim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <random>
+#include <vector>
+
+namespace {
+
+enum EventType {
+  RIDER_ARRIVES = 0,
+  TRAIN_RETURNS,      //back on the brake run, waiting for the station
+  UNLOAD_DONE,
+  DISPATCH
+};
+
+struct Event {
+  double time;
+  long long order;    //ties go to the event scheduled first, so runs repeat exactly
+  int type;
+  int train;
+};
+
+struct LaterFirst {
+  bool operator()(const Event& a, const Event& b) const
+  {
+    return (a.time != b.time) ? a.time > b.time : a.order > b.order;
+  }
+};
+
+//Waits are binned rather than stored, so runs of many days stay small.
+//Longer waits than the bins cover are only counted.
+const double WAIT_BIN = 5.0;
+const int WAIT_BINS = (int)(PARK_MAX_BINNED_WAIT / WAIT_BIN);
+
+double waitPercentile(const std::vector<long long>& histogram, long long total, double p)
+{
+  if (total == 0)
+    return 0.0;
+  long long target = (long long)ceil(p * total);
+  long long seen = 0;
+  for (size_t b = 0; b < histogram.size(); b++)
+  {
+    seen += histogram[b];
+    if (seen >= target)
+      return (b + 1) * WAIT_BIN;
+  }
+  return INFINITY;
+}
+
+}
+
+ParkStats runPark(const VelocityProfile& profile, const ParkOptions& options)
+{
+  ParkStats stats;
+  stats.arrivals = stats.riders = stats.dispatches = stats.events = 0;
+  stats.maxQueue = 0;
+  stats.maxWait = 0.0;
+  stats.longWaits = 0;
+  stats.days = 0;
+  stats.afterClose = 0;
+  stats.overtime = 0.0;
+  stats.maxOvertime = 0.0;
+
+  const double open = options.hours * 3600.0;
+  const double dayLength = options.dayHours > 0.0 ? options.dayHours * 3600.0 : open;
+  const double lap = profile.lapTime();
+  const int seats = options.cars * options.seatsPerCar;
+  stats.cycleTime = lap + options.unloadTime + options.loadTime;
+
+  std::mt19937 random(options.seed);
+  std::exponential_distribution<double> gap(options.arrivalsPerHour / 3600.0);
+
+  std::vector<long long> histogram(WAIT_BINS, 0);
+  double waitSum = 0.0;
+  long long seatsOffered = 0;
+
+  //Every day runs from opening, time 0, to its queue being empty after close
+  for (double left = open; left > 0.0; left -= dayLength)
+  {
+    const double close = std::min(dayLength, left);
+    stats.days++;
+
+    std::priority_queue<Event, std::vector<Event>, LaterFirst> events;
+    long long order = 0;
+    auto schedule = [&](double time, int type, int train) {
+      Event e = { time, order++, type, train };
+      events.push(e);
+    };
+
+    std::deque<double> queue;           //arrival time of every rider waiting
+    std::deque<int> brakeRun;           //trains waiting for the station
+    bool stationBusy = false;
+    double lateness = 0.0;              //last dispatch past closing
+
+    if (options.arrivalsPerHour > 0.0)
+      schedule(gap(random), RIDER_ARRIVES, -1);
+    //Every train starts out coming into the station, spread over one cycle
+    for (int t = 0; t < options.trains; t++)
+    {
+      schedule(t * stats.cycleTime / options.trains, TRAIN_RETURNS, t);
+    }
+
+    while (!events.empty() && (events.top().time <= close || !queue.empty()))
+    {
+      Event e = events.top();
+      events.pop();
+      stats.events++;
+
+      switch (e.type)
+      {
+      case RIDER_ARRIVES:
+        //the queue is shut at closing
+        if (e.time > close)
+          break;
+        queue.push_back(e.time);
+        stats.arrivals++;
+        stats.maxQueue = std::max(stats.maxQueue, (int)queue.size());
+        schedule(e.time + gap(random), RIDER_ARRIVES, -1);
+        break;
+
+      case TRAIN_RETURNS:
+        if (stationBusy)
+        {
+          brakeRun.push_back(e.train);
+        } else
+        {
+          stationBusy = true;
+          schedule(e.time + options.unloadTime, UNLOAD_DONE, e.train);
+        }
+        break;
+
+      case UNLOAD_DONE:
+        schedule(e.time + options.loadTime, DISPATCH, e.train);
+        break;
+
+      case DISPATCH:
+      {
+        //Everyone in the queue by now who fits gets on
+        int boarding = std::min(seats, (int)queue.size());
+        for (int r = 0; r < boarding; r++)
+        {
+          double wait = e.time - queue.front();
+          queue.pop_front();
+          waitSum += wait;
+          stats.maxWait = std::max(stats.maxWait, wait);
+          if (wait < PARK_MAX_BINNED_WAIT)
+            histogram[std::min((int)(wait / WAIT_BIN), WAIT_BINS - 1)]++;
+          else
+            stats.longWaits++;
+        }
+        stats.riders += boarding;
+        stats.dispatches++;
+        seatsOffered += seats;
+        if (e.time > close)
+        {
+          stats.afterClose += boarding;
+          lateness = e.time - close;
+        }
+
+        schedule(e.time + lap, TRAIN_RETURNS, e.train);
+
+        //The next train off the brake run moves in
+        if (!brakeRun.empty())
+        {
+          int next = brakeRun.front();
+          brakeRun.pop_front();
+          schedule(e.time + options.unloadTime, UNLOAD_DONE, next);
+        } else
+        {
+          stationBusy = false;
+        }
+        break;
+      }
+      }
+    }
+    stats.overtime += lateness;
+    stats.maxOvertime = std::max(stats.maxOvertime, lateness);
+  }
+
+  //Riders let in after closing would otherwise count towards the rate
+  //without their time, so an oversubscribed ride would show its arrivals
+  stats.ridersPerHour = (open > 0.0) ? (stats.riders - stats.afterClose) * 3600.0 / open : 0.0;
+  stats.meanLoad = seatsOffered ? (double)stats.riders / seatsOffered : 0.0;
+  stats.meanWait = stats.riders ? waitSum / stats.riders : 0.0;
+  stats.p50Wait = waitPercentile(histogram, stats.riders, 0.50);
+  stats.p90Wait = waitPercentile(histogram, stats.riders, 0.90);
+  stats.p99Wait = waitPercentile(histogram, stats.riders, 0.99);
+
+  const double bands[4] = { 5.0, 15.0, 30.0, 60.0 };
+  long long below[4] = { 0, 0, 0, 0 };
+  for (int b = 0; b < WAIT_BINS; b++)
+  {
+    for (int k = 0; k < 4; k++)
+    {
+      if ((b + 1) * WAIT_BIN <= bands[k] * 60.0)
+        below[k] += histogram[b];
+    }
+  }
+  for (int k = 0; k < 5; k++)
+  {
+    long long inBand = (k < 4) ? below[k] - (k ? below[k - 1] : 0) : stats.riders - below[3];
+    stats.waitBands[k] = stats.riders ? (double)inBand / stats.riders : 0.0;
+  }
+
+  return stats;
+}
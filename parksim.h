@@ -0,0 +1,60 @@
+#ifndef PARKSIM_H
+#define PARKSIM_H
+
+#include "velocityprofile.h"
+
+//Settings for the park throughput simulation
+struct ParkOptions {
+  double arrivalsPerHour;   //riders joining the queue, Poisson arrivals
+  double hours;             //operating hours to simulate
+  double dayHours;          //opening hours of one day, the queue empties after each
+  int trains;
+  int cars;
+  int seatsPerCar;
+  double unloadTime;        //seconds in the station before loading starts
+  double loadTime;          //seconds from loading start to dispatch
+  unsigned int seed;
+
+  ParkOptions(): arrivalsPerHour(1000.0), hours(12.0), dayHours(12.0), trains(2), cars(5), seatsPerCar(4),
+                 unloadTime(15.0), loadTime(30.0), seed(1) {}
+};
+
+//Totals from runPark. Wait times are in seconds, from joining the queue
+//to the dispatch of the train the rider boards. Waits are binned up to
+//PARK_MAX_BINNED_WAIT; a percentile past that is INFINITY.
+struct ParkStats {
+  long long arrivals;
+  long long riders;         //riders dispatched
+  long long dispatches;
+  long long events;
+  double ridersPerHour;     //riders dispatched by closing over the open hours
+  double meanLoad;          //fraction of seats filled per dispatch
+  double meanWait;
+  double p50Wait;
+  double p90Wait;
+  double p99Wait;
+  double maxWait;
+  long long longWaits;      //riders who waited more than PARK_MAX_BINNED_WAIT
+  int maxQueue;
+  int days;
+  long long afterClose;     //riders dispatched after closing, from the queue left then
+  double overtime;          //seconds the ride ran past closing, over every day
+  double maxOvertime;       //longest it took to empty the queue after closing
+  double cycleTime;         //dispatch to dispatch of one train, unloaded
+  double waitBands[5];      //share of riders waiting <5, <15, <30, <60 and 60+ min
+};
+
+//Longest wait the percentiles can tell apart, seconds
+const double PARK_MAX_BINNED_WAIT = 24 * 3600.0;
+
+//Discrete event simulation of one ride: riders queue, trains unload, load
+//and are dispatched from a single station, then spend the lap time from
+//the velocity profile on the track before coming back. A train returning
+//to an occupied station waits on the brake run.
+//
+//options.hours is split into days of options.dayHours. At closing the
+//queue stops taking riders and the trains keep running until everyone in
+//it has ridden, and each day starts with an empty queue.
+ParkStats runPark(const VelocityProfile& profile, const ParkOptions& options);
+
+#endif
@@ -0,0 +1,189 @@
+#include "replay.h"
+
+#include <stdexcept>
+
+const uint32_t REPLAY_FILE_MAGIC = 0x4c50524b;    //"KRPL"
+const uint32_t REPLAY_FILE_VERSION = 1;
+
+//One byte in front of every record after the header
+enum ReplayTag {
+  TAG_TICK = 1,     //uint32 checksum
+  TAG_FRAME,        //uint32 steps, float alpha
+  TAG_EVENT,        //uint8 type, int32 a, int32 b, float x, float y
+  TAG_END
+};
+
+uint32_t checksumBytes(const void* data, size_t size, uint32_t hash)
+{
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+uint32_t checksumTrack(const std::vector<vec3>& points, const VelocityProfile& profile)
+{
+  uint32_t hash = checksumBytes(0, 0);
+  for (size_t k = 0; k < points.size(); k++)
+  {
+    float v = profile.velocityAt(profile.sampleArcLength(k));
+    hash = checksumBytes(&points[k], sizeof(vec3), hash);
+    hash = checksumBytes(&v, sizeof(v), hash);
+  }
+  return hash;
+}
+
+uint32_t checksumTrain(const Train& train)
+{
+  float centre = train.arcLength();
+  float previous = train.interpolatedArcLength(0.f);
+  double travelled = train.distance();
+  uint32_t hash = checksumBytes(&centre, sizeof(centre));
+  hash = checksumBytes(&previous, sizeof(previous), hash);
+  return checksumBytes(&travelled, sizeof(travelled), hash);
+}
+
+bool ReplayRecorder::open(const std::string& path, const ReplayHeader& header)
+{
+  close();
+  file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  ticks = 0;
+  frames = 0;
+
+  uint32_t magic[2] = { REPLAY_FILE_MAGIC, REPLAY_FILE_VERSION };
+  uint32_t trackLength = header.track.size();
+  int32_t cars = header.cars;
+  fwrite(magic, sizeof(magic), 1, file);
+  fwrite(&trackLength, sizeof(trackLength), 1, file);
+  fwrite(header.track.data(), 1, trackLength, file);
+  fwrite(&header.simRate, sizeof(header.simRate), 1, file);
+  fwrite(&cars, sizeof(cars), 1, file);
+  fwrite(&header.coupling, sizeof(header.coupling), 1, file);
+  fwrite(&header.startArcLength, sizeof(header.startArcLength), 1, file);
+  fwrite(&header.trackChecksum, sizeof(header.trackChecksum), 1, file);
+  return true;
+}
+
+void ReplayRecorder::tick(uint32_t checksum)
+{
+  if (!file)
+    return;
+  fputc(TAG_TICK, file);
+  fwrite(&checksum, sizeof(checksum), 1, file);
+  ticks++;
+}
+
+void ReplayRecorder::frame(uint32_t steps, float alpha)
+{
+  if (!file)
+    return;
+  fputc(TAG_FRAME, file);
+  fwrite(&steps, sizeof(steps), 1, file);
+  fwrite(&alpha, sizeof(alpha), 1, file);
+  frames++;
+}
+
+void ReplayRecorder::event(int type, int a, int b, float x, float y)
+{
+  if (!file)
+    return;
+  int32_t values[2] = { a, b };
+  float position[2] = { x, y };
+  fputc(TAG_EVENT, file);
+  fputc(type, file);
+  fwrite(values, sizeof(values), 1, file);
+  fwrite(position, sizeof(position), 1, file);
+}
+
+bool ReplayRecorder::close()
+{
+  if (!file)
+    return true;
+  fputc(TAG_END, file);
+  bool ok = !ferror(file);
+  ok = (fclose(file) == 0) && ok;
+  file = 0;
+  return ok;
+}
+
+//Reads exactly size bytes or throws
+static void readBytes(FILE* f, void* data, size_t size, const std::string& path)
+{
+  if (size > 0 && fread(data, size, 1, f) != 1)
+  {
+    fclose(f);
+    throw std::runtime_error("Replay " + path + " is truncated");
+  }
+}
+
+Replay loadReplay(const std::string& path)
+{
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f)
+    throw std::runtime_error("Unable to open file.");
+
+  Replay replay;
+  ReplayHeader& header = replay.header;
+  uint32_t magic[2];
+  uint32_t trackLength;
+  int32_t cars;
+  readBytes(f, magic, sizeof(magic), path);
+  if (magic[0] != REPLAY_FILE_MAGIC || magic[1] != REPLAY_FILE_VERSION)
+  {
+    fclose(f);
+    throw std::runtime_error(path + " is not a version 1 replay");
+  }
+  readBytes(f, &trackLength, sizeof(trackLength), path);
+  header.track.resize(trackLength);
+  readBytes(f, &header.track[0], trackLength, path);
+  readBytes(f, &header.simRate, sizeof(header.simRate), path);
+  readBytes(f, &cars, sizeof(cars), path);
+  readBytes(f, &header.coupling, sizeof(header.coupling), path);
+  readBytes(f, &header.startArcLength, sizeof(header.startArcLength), path);
+  readBytes(f, &header.trackChecksum, sizeof(header.trackChecksum), path);
+  header.cars = cars;
+
+  //A run cut off by a crash may have no end tag, what was written still replays
+  for (int tag = fgetc(f); tag != EOF && tag != TAG_END; tag = fgetc(f))
+  {
+    uint32_t value;
+    if (tag == TAG_TICK)
+    {
+      readBytes(f, &value, sizeof(value), path);
+      replay.checksums.push_back(value);
+    } else if (tag == TAG_FRAME)
+    {
+      float alpha;
+      readBytes(f, &value, sizeof(value), path);
+      readBytes(f, &alpha, sizeof(alpha), path);
+      replay.frameSteps.push_back(value);
+      replay.frameAlpha.push_back(alpha);
+    } else if (tag == TAG_EVENT)
+    {
+      ReplayEvent e;
+      int32_t values[2];
+      float position[2];
+      e.type = fgetc(f);
+      readBytes(f, values, sizeof(values), path);
+      readBytes(f, position, sizeof(position), path);
+      e.tick = replay.checksums.size();
+      e.frame = replay.frameSteps.size();
+      e.a = values[0];
+      e.b = values[1];
+      e.x = position[0];
+      e.y = position[1];
+      replay.events.push_back(e);
+    } else
+    {
+      fclose(f);
+      throw std::runtime_error("Replay " + path + " has a bad record");
+    }
+  }
+  fclose(f);
+  return replay;
+}
@@ -0,0 +1,97 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "train.h"
+
+using namespace glm;
+
+//Input that reaches the ride through the GLFW callbacks
+enum ReplayEventType {
+  REPLAY_KEY = 0,           //a is the key, b the action
+  REPLAY_MOUSE_BUTTON,      //a is the button, b the action
+  REPLAY_MOUSE_POS          //x, y in -1..1 window coordinates
+};
+
+struct ReplayEvent {
+  uint32_t tick;            //simulation steps run before the event
+  uint32_t frame;           //display frames run before the event
+  int type;
+  int a, b;
+  float x, y;
+};
+
+//Everything needed to start the same run again
+struct ReplayHeader {
+  std::string track;
+  double simRate;
+  int cars;
+  float coupling;
+  float startArcLength;
+  uint32_t trackChecksum;   //see checksumTrack, so a changed track is caught
+
+  ReplayHeader(): simRate(0.0), cars(0), coupling(0.f), startArcLength(0.f), trackChecksum(0) {}
+};
+
+//A recorded run: the header, how many fixed steps every display frame
+//ran and how far it drew the train towards the next, a checksum of the
+//simulation state after every step, and the input
+struct Replay {
+  ReplayHeader header;
+  std::vector<uint32_t> frameSteps;
+  std::vector<float> frameAlpha;
+  std::vector<uint32_t> checksums;
+  std::vector<ReplayEvent> events;
+};
+
+//FNV-1a, continuing from hash
+uint32_t checksumBytes(const void* data, size_t size, uint32_t hash = 2166136261u);
+
+//Checksum of the curve points and the speed the profile gives at each
+uint32_t checksumTrack(const std::vector<vec3>& points, const VelocityProfile& profile);
+
+//Bit exact checksum of everything a train carries from step to step
+uint32_t checksumTrain(const Train& train);
+
+//Writes a run to a compact binary file as it happens. Ticks and frames
+//are counted as they are written, so events only store their payload.
+class ReplayRecorder {
+public:
+  ReplayRecorder(): file(0), ticks(0), frames(0) {}
+  ~ReplayRecorder() { close(); }
+
+  //Returns false if the file can't be created
+  bool open(const std::string& path, const ReplayHeader& header);
+  bool isOpen() const { return file != 0; }
+
+  //After every fixed step, with the state checksum
+  void tick(uint32_t checksum);
+  //After the steps of a display frame, with the interpolation it drew at
+  void frame(uint32_t steps, float alpha);
+  void event(int type, int a, int b, float x = 0.f, float y = 0.f);
+
+  //Returns false if anything failed to write
+  bool close();
+
+  uint32_t tickCount() const { return ticks; }
+
+private:
+  ReplayRecorder(const ReplayRecorder&);
+  ReplayRecorder& operator=(const ReplayRecorder&);
+
+  FILE* file;
+  uint32_t ticks;
+  uint32_t frames;
+};
+
+//Reads a file written by ReplayRecorder. Throws std::runtime_error if it
+//can't be opened or isn't a replay.
+Replay loadReplay(const std::string& path);
+
+#endif
@@ -0,0 +1,107 @@
+#include "shaderprogram.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(FrameUniforms) == 64, "FrameUniforms has to match FrameBlock's std140 layout");
+static_assert(sizeof(ObjectUniforms) == 64, "ObjectUniforms has to match ObjectBlock's std140 layout");
+
+//Program last made current by useProgram
+static GLuint currentProgram = 0;
+
+void useProgram(GLuint program)
+{
+  if (program == currentProgram)
+    return;
+  glUseProgram(program);
+  currentProgram = program;
+}
+
+ShaderProgram::ShaderProgram(GLuint program): id(program)
+{
+  GLint count = 0, longest = 0;
+  glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+  std::vector<char> name(std::max(longest, 1));
+  for (GLint u = 0; u < count; u++)
+  {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(id, u, name.size(), &length, &size, &type, &name[0]);
+    //Uniforms inside blocks have no location, they come from the buffers
+    GLint location = glGetUniformLocation(id, &name[0]);
+    if (location >= 0)
+      uniforms.push_back(std::make_pair(std::string(&name[0], length), location));
+  }
+
+  GLuint frameIndex = glGetUniformBlockIndex(id, "FrameBlock");
+  if (frameIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(id, frameIndex, FRAME_BLOCK);
+  GLuint objectIndex = glGetUniformBlockIndex(id, "ObjectBlock");
+  if (objectIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(id, objectIndex, OBJECT_BLOCK);
+}
+
+GLint ShaderProgram::location(const std::string& name) const
+{
+  for (size_t u = 0; u < uniforms.size(); u++)
+  {
+    if (uniforms[u].first == name)
+      return uniforms[u].second;
+  }
+  return -1;
+}
+
+SceneUniforms::SceneUniforms(int objects): maxObjects(std::max(objects, 1)), bound(-1)
+{
+  GLint alignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  alignment = std::max(alignment, 1);
+  stride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+
+  glGenBuffers(COUNT, buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer[FRAME]);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), 0, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer[OBJECTS]);
+  glBufferData(GL_UNIFORM_BUFFER, stride * maxObjects, 0, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK, buffer[FRAME]);
+}
+
+SceneUniforms::~SceneUniforms()
+{
+  glDeleteBuffers(COUNT, buffer);
+}
+
+void SceneUniforms::setFrame(const FrameUniforms& frame)
+{
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer[FRAME]);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void SceneUniforms::setObjects(int first, const mat4* models, int count)
+{
+  count = std::min(count, maxObjects - first);
+  if (first < 0 || count <= 0)
+    return;
+
+  staging.resize(stride * count);
+  for (int n = 0; n < count; n++)
+  {
+    memcpy(&staging[n * stride], &models[n], sizeof(mat4));
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer[OBJECTS]);
+  glBufferSubData(GL_UNIFORM_BUFFER, first * stride, staging.size(), &staging[0]);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void SceneUniforms::bindObject(int object)
+{
+  if (object == bound || object < 0 || object >= maxObjects)
+    return;
+  glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK, buffer[OBJECTS], object * stride, sizeof(ObjectUniforms));
+  bound = object;
+}
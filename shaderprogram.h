@@ -0,0 +1,86 @@
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "glad/glad.h"
+
+using namespace glm;
+
+//Binding points of the uniform blocks the programs share
+enum UniformBlockBinding {
+  FRAME_BLOCK = 0,      //FrameBlock, written once a frame
+  OBJECT_BLOCK          //ObjectBlock, pointed at one object's range per draw
+};
+
+//FrameBlock in std140 layout
+struct FrameUniforms {
+  mat4 viewProjectionMatrix;    //window ratio, perspective and camera
+};
+
+//ObjectBlock in std140 layout
+struct ObjectUniforms {
+  mat4 modelMatrix;
+};
+
+//Makes program current unless it already is. Everything that binds a
+//program goes through here so the check stays right.
+void useProgram(GLuint program);
+
+//A linked program with every uniform's location looked up once, at link
+//time. Whichever of FrameBlock and ObjectBlock it declares are tied to
+//their binding points here too, so drawing with it only needs use().
+class ShaderProgram {
+public:
+  ShaderProgram(): id(0) {}
+  explicit ShaderProgram(GLuint program);
+
+  GLuint program() const { return id; }
+  void use() const { useProgram(id); }
+
+  //-1 if the program has no active uniform called name. Meant for setup,
+  //keep the result rather than calling it per draw.
+  GLint location(const std::string& name) const;
+
+private:
+  GLuint id;
+  std::vector<std::pair<std::string, GLint> > uniforms;
+};
+
+//The buffers behind FrameBlock and ObjectBlock. The frame block is
+//written once a frame. Object model matrices sit at aligned offsets in
+//one buffer, so a run of them goes up in one call and a draw only has to
+//bind its range.
+class SceneUniforms {
+public:
+  //Room for maxObjects model matrices
+  explicit SceneUniforms(int maxObjects);
+  ~SceneUniforms();
+  SceneUniforms(const SceneUniforms&) = delete;
+  SceneUniforms& operator=(const SceneUniforms&) = delete;
+
+  void setFrame(const FrameUniforms& frame);
+
+  //Uploads the model matrices of objects first to first + count - 1
+  void setObjects(int first, const mat4* models, int count);
+
+  //Points ObjectBlock at object's model matrix for the next draws
+  void bindObject(int object);
+
+  int capacity() const { return maxObjects; }
+
+private:
+  enum { FRAME = 0, OBJECTS, COUNT };
+
+  GLuint buffer[COUNT];
+  GLint stride;           //bytes from one object to the next
+  int maxObjects;
+  int bound;              //object ObjectBlock points at, -1 for none
+  std::vector<unsigned char> staging;
+};
+
+#endif
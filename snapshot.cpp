@@ -0,0 +1,102 @@
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+const uint32_t SNAPSHOT_FILE_MAGIC = 0x50414e53;    //"SNAP"
+const uint32_t SNAPSHOT_FILE_VERSION = 1;
+
+static_assert(std::is_trivially_copyable<TrainState>::value, "TrainState is copied as bytes");
+static_assert(sizeof(SnapshotHeader) % alignof(TrainState) == 0, "train states follow the header");
+
+Snapshot::Snapshot():
+  data(sizeof(SnapshotHeader), 0)
+{
+}
+
+void Snapshot::capture(uint64_t tick, double simRate, uint32_t trackChecksum, const std::vector<Train>& trains)
+{
+  data.resize(sizeof(SnapshotHeader) + trains.size() * sizeof(TrainState));
+
+  SnapshotHeader* h = (SnapshotHeader*)&data[0];
+  h->magic = SNAPSHOT_FILE_MAGIC;
+  h->version = SNAPSHOT_FILE_VERSION;
+  h->headerSize = sizeof(SnapshotHeader);
+  h->stateSize = sizeof(TrainState);
+  h->tick = tick;
+  h->simRate = simRate;
+  h->trackChecksum = trackChecksum;
+  h->trains = trains.size();
+
+  TrainState* out = (TrainState*)&data[sizeof(SnapshotHeader)];
+  for (size_t t = 0; t < trains.size(); t++)
+  {
+    out[t] = trains[t].state();
+  }
+}
+
+void Snapshot::restore(const VelocityProfile& profile, std::vector<Train>* trains) const
+{
+  uint32_t count = header().trains;
+  const TrainState* in = states();
+  trains->clear();
+  trains->reserve(count);
+  for (uint32_t t = 0; t < count; t++)
+  {
+    trains->push_back(Train(profile, in[t]));
+  }
+}
+
+bool Snapshot::save(const std::string& path) const
+{
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool ok = fwrite(&data[0], data.size(), 1, file) == 1;
+  return (fclose(file) == 0) && ok;
+}
+
+void Snapshot::load(const std::string& path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("unable to open file");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader))
+  {
+    close(fd);
+    throw std::runtime_error("not a snapshot file");
+  }
+  size_t size = st.st_size;
+  void* map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error("unable to map file");
+
+  SnapshotHeader h;
+  memcpy(&h, map, sizeof(h));
+  const char* error = 0;
+  if (h.magic != SNAPSHOT_FILE_MAGIC)
+    error = "not a snapshot file";
+  else if (h.version != SNAPSHOT_FILE_VERSION || h.headerSize != sizeof(SnapshotHeader) ||
+           h.stateSize != sizeof(TrainState))
+    error = "unsupported snapshot version";
+  else if (size != sizeof(SnapshotHeader) + (size_t)h.trains * sizeof(TrainState))
+    error = "truncated snapshot file";
+
+  if (!error)
+  {
+    data.resize(size);
+    memcpy(&data[0], map, size);
+  }
+  munmap(map, size);
+  if (error)
+    throw std::runtime_error(error);
+}
@@ -0,0 +1,53 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "train.h"
+
+//Fixed size block at the front of a snapshot. The train states follow it
+//directly, so the whole snapshot is one flat run of bytes that can be
+//written, mapped and copied without any parsing.
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t headerSize;      //sizeof(SnapshotHeader)
+  uint32_t stateSize;       //sizeof(TrainState), so a changed layout is caught
+  uint64_t tick;            //simulation steps run before the snapshot
+  double simRate;
+  uint32_t trackChecksum;   //see checksumTrack, a snapshot only fits its own track
+  uint32_t trains;
+};
+
+//The state of every train at one tick. Taking one is a copy of the train
+//states into a single buffer and restoring it is a copy back, so a warm
+//simulation can be saved, reloaded or forked into many runs that all start
+//from the same point.
+class Snapshot {
+public:
+  Snapshot();
+
+  //Copies the state of the trains after tick steps
+  void capture(uint64_t tick, double simRate, uint32_t trackChecksum, const std::vector<Train>& trains);
+
+  //Replaces trains with the saved ones, running on profile
+  void restore(const VelocityProfile& profile, std::vector<Train>* trains) const;
+
+  //Writes the buffer in one go. Returns false if it fails.
+  bool save(const std::string& path) const;
+
+  //Maps the file and copies it in. Throws std::runtime_error if it isn't a
+  //snapshot of this version.
+  void load(const std::string& path);
+
+  const SnapshotHeader& header() const { return *(const SnapshotHeader*)&data[0]; }
+  const TrainState* states() const { return (const TrainState*)&data[sizeof(SnapshotHeader)]; }
+  size_t bytes() const { return data.size(); }
+
+private:
+  std::vector<unsigned char> data;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "socketio.h"
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+  const char* p = (const char*)data;
+  while (size > 0)
+  {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool readAll(int fd, void* data, size_t size)
+{
+  char* p = (char*)data;
+  while (size > 0)
+  {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void setNoDelay(int fd)
+{
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int connectTcp(const std::string& address)
+{
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos)
+    return -1;
+  std::string host = address.substr(0, colon);
+  std::string port = address.substr(colon + 1);
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* found;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+    return -1;
+
+  int fd = -1;
+  for (struct addrinfo* a = found; a && fd < 0; a = a->ai_next)
+  {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(found);
+
+  if (fd >= 0)
+    setNoDelay(fd);
+  return fd;
+}
+
+int listenTcp(int port, int backlog)
+{
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0)
+    return -1;
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, backlog) != 0)
+  {
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+
+int boundPort(int listener)
+{
+  struct sockaddr_in address;
+  socklen_t size = sizeof(address);
+  if (getsockname(listener, (struct sockaddr*)&address, &size) != 0)
+    return -1;
+  return ntohs(address.sin_port);
+}
+
+int acceptTcp(int listener)
+{
+  int fd;
+  do
+  {
+    fd = accept(listener, 0, 0);
+  } while (fd < 0 && errno == EINTR);
+  if (fd >= 0)
+    setNoDelay(fd);
+  return fd;
+}
+
+bool setNonBlocking(int fd, bool nonBlocking)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0)
+    return false;
+  flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  return fcntl(fd, F_SETFL, flags) == 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SOCKETIO_H
+#define SOCKETIO_H
+
+#include <cstddef>
+#include <string>
+
+//Small helpers over POSIX sockets shared by the park cluster and the
+//state stream. Every call returns false or -1 on failure, with errno set.
+
+//Write or read exactly size bytes, retrying short transfers and signals.
+//readAll fails at the end of the stream.
+bool writeAll(int fd, const void* data, size_t size);
+bool readAll(int fd, void* data, size_t size);
+
+//Connects to host:port with TCP_NODELAY set, since everything sent over
+//these sockets is small and waited for. Returns the socket, or -1.
+int connectTcp(const std::string& address);
+
+//Listens on port on every interface, 0 for any free port. Returns the
+//listening socket, or -1.
+int listenTcp(int port, int backlog);
+
+//The port a listening socket ended up on
+int boundPort(int listener);
+
+//Accepts a connection and sets TCP_NODELAY on it. Returns the socket, or -1.
+int acceptTcp(int listener);
+
+//Switches a socket between blocking and non-blocking
+bool setNonBlocking(int fd, bool nonBlocking);
+
+#endif
@@ -0,0 +1,563 @@
+#include "statestream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "frametable.h"
+#include "replay.h"
+#include "socketio.h"
+
+const uint32_t STREAM_MAGIC = 0x4d525453;   //"STRM"
+const uint32_t STREAM_VERSION = 1;
+
+//Bytes per train in a keyframe: position, step, stage
+const size_t STREAM_KEY_BYTES = 5;
+
+//Bytes queued for a viewer before it starts missing frames
+const size_t STREAM_MAX_PENDING = 1 << 20;
+
+//Largest frame a viewer accepts, to catch a corrupt stream
+const uint32_t STREAM_MAX_FRAME = 1 << 26;
+
+StreamEncoder::StreamEncoder(int trains, float trackLength, int keyframeInterval):
+  count(trains), scale(65536.f / trackLength), interval(std::max(keyframeInterval, 1)), keyTick(0),
+  haveKey(false), previous(trains, 0), keyPosition(trains, 0), keyStep(trains, 0)
+{
+}
+
+uint16_t StreamEncoder::quantize(float s) const
+{
+  return (uint16_t)(uint32_t)floor(s * scale + 0.5f);
+}
+
+bool StreamEncoder::encode(uint32_t tick, const float* arcLength, const uint8_t* stage, std::string* out)
+{
+  bool key = !haveKey || tick < keyTick || tick - keyTick >= (uint32_t)interval;
+
+  StreamFrame frame;
+  frame.tick = tick;
+  size_t at = out->size();
+  out->resize(at + sizeof(frame));
+
+  if (key)
+  {
+    //The step is only known once there is a previous tick to take it from
+    for (int i = 0; i < count; i++)
+    {
+      uint16_t q = quantize(arcLength[i]);
+      unsigned char record[STREAM_KEY_BYTES];
+      keyStep[i] = haveKey ? (int16_t)(uint16_t)(q - previous[i]) : 0;
+      keyPosition[i] = q;
+      memcpy(record, &q, 2);
+      memcpy(record + 2, &keyStep[i], 2);
+      record[4] = stage[i];
+      out->append((const char*)record, sizeof(record));
+      previous[i] = q;
+    }
+    keyTick = tick;
+    haveKey = true;
+  } else
+  {
+    uint32_t t = tick - keyTick;
+    for (int i = 0; i < count; i++)
+    {
+      uint16_t q = quantize(arcLength[i]);
+      uint16_t predicted = (uint16_t)(keyPosition[i] + keyStep[i] * t);
+      int32_t residual = (int16_t)(uint16_t)(q - predicted);
+      //zigzag so small negative residuals stay small, then a varint
+      uint32_t value = ((uint32_t)((residual << 1) ^ (residual >> 31)) << 2) | (stage[i] & 3);
+      while (value >= 0x80)
+      {
+        out->push_back((char)(value | 0x80));
+        value >>= 7;
+      }
+      out->push_back((char)value);
+      previous[i] = q;
+    }
+  }
+
+  frame.keyTick = keyTick;
+  frame.size = out->size() - at - sizeof(frame);
+  memcpy(&(*out)[at], &frame, sizeof(frame));
+  return key;
+}
+
+void StreamDecoder::reset(const StreamHello& hello)
+{
+  length = hello.trackLength;
+  haveKey = false;
+  haveState = false;
+  keyPosition.assign(hello.trains, 0);
+  keyStep.assign(hello.trains, 0);
+  arcLength.assign(hello.trains, 0.f);
+  stage.assign(hello.trains, 0);
+}
+
+bool StreamDecoder::decode(const StreamFrame& frame, const unsigned char* payload)
+{
+  int count = arcLength.size();
+  float step = length / 65536.f;
+
+  if (frame.tick == frame.keyTick)
+  {
+    if (frame.size != count * STREAM_KEY_BYTES)
+      return false;
+    for (int i = 0; i < count; i++)
+    {
+      const unsigned char* record = payload + i * STREAM_KEY_BYTES;
+      memcpy(&keyPosition[i], record, 2);
+      memcpy(&keyStep[i], record + 2, 2);
+      stage[i] = record[4];
+      arcLength[i] = keyPosition[i] * step;
+    }
+    keyTick = frame.tick;
+    haveKey = true;
+  } else
+  {
+    if (!haveKey || frame.keyTick != keyTick)
+      return false;
+    uint32_t t = frame.tick - keyTick;
+    size_t at = 0;
+    for (int i = 0; i < count; i++)
+    {
+      uint32_t value = 0;
+      for (int shift = 0; ; shift += 7)
+      {
+        if (at >= frame.size || shift > 28)
+          return false;
+        unsigned char b = payload[at++];
+        value |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+          break;
+      }
+      uint32_t zigzag = value >> 2;
+      int32_t residual = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+      uint16_t q = (uint16_t)(keyPosition[i] + keyStep[i] * t + residual);
+      stage[i] = value & 3;
+      arcLength[i] = q * step;
+    }
+    if (at != frame.size)
+      return false;
+  }
+
+  tickNow = frame.tick;
+  haveState = true;
+  return true;
+}
+
+StreamServer::StreamServer():
+  listener(-1), listenPort(0), encoder(0), keyCount(0), frameCount(0), encoded(0), keyBytes(0), skipped(0)
+{
+}
+
+StreamServer::~StreamServer()
+{
+  for (size_t c = 0; c < clients.size(); c++)
+    close(clients[c].fd);
+  if (listener >= 0)
+    close(listener);
+  delete encoder;
+}
+
+bool StreamServer::listen(int port, const StreamHello& hello)
+{
+  listener = listenTcp(port, 16);
+  if (listener < 0 || !setNonBlocking(listener, true))
+    return false;
+  listenPort = boundPort(listener);
+
+  header = hello;
+  header.magic = STREAM_MAGIC;
+  header.version = STREAM_VERSION;
+  delete encoder;
+  encoder = new StreamEncoder(header.trains, header.trackLength, header.keyframeInterval);
+  arcLength.resize(header.trains);
+  stage.resize(header.trains);
+  return true;
+}
+
+void StreamServer::accept()
+{
+  int fd;
+  while ((fd = acceptTcp(listener)) >= 0)
+  {
+    setNonBlocking(fd, true);
+    Client client;
+    client.fd = fd;
+    client.pending.assign((const char*)&header, sizeof(header));
+    client.needKey = true;
+    client.started = false;
+    clients.push_back(client);
+  }
+}
+
+bool StreamServer::send(Client* client)
+{
+  size_t sent = 0;
+  while (sent < client->pending.size())
+  {
+    ssize_t n = ::send(client->fd, client->pending.data() + sent, client->pending.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (n <= 0)
+      return false;
+    sent += n;
+  }
+  client->pending.erase(0, sent);
+  return true;
+}
+
+void StreamServer::publish(uint32_t tick, const std::vector<Train>& trains)
+{
+  if (!encoder)
+    return;
+  accept();
+
+  size_t count = std::min<size_t>(trains.size(), header.trains);
+  for (size_t t = 0; t < count; t++)
+  {
+    arcLength[t] = trains[t].arcLength();
+    stage[t] = trains[t].stage();
+  }
+  frame.clear();
+  bool key = encoder->encode(tick, &arcLength[0], &stage[0], &frame);
+  frameCount++;
+  encoded += frame.size();
+  if (key)
+  {
+    keyCount++;
+    keyBytes += frame.size();
+  }
+
+  for (size_t c = 0; c < clients.size(); )
+  {
+    Client& client = clients[c];
+    if (client.pending.size() > STREAM_MAX_PENDING)
+      client.needKey = true;
+    if (client.needKey && (!key || client.pending.size() > STREAM_MAX_PENDING))
+    {
+      skipped += client.started;
+    } else
+    {
+      client.needKey = false;
+      client.started = true;
+      client.pending += frame;
+    }
+
+    if (send(&client))
+    {
+      c++;
+    } else
+    {
+      close(client.fd);
+      clients.erase(clients.begin() + c);
+    }
+  }
+}
+
+void StreamServer::flush()
+{
+  for (size_t c = 0; c < clients.size(); )
+  {
+    if (send(&clients[c]))
+    {
+      c++;
+    } else
+    {
+      close(clients[c].fd);
+      clients.erase(clients.begin() + c);
+    }
+  }
+}
+
+bool StreamViewer::connect(const std::string& address)
+{
+  disconnect();
+  fd = connectTcp(address);
+  if (fd < 0 || !setNonBlocking(fd, true))
+  {
+    disconnect();
+    return false;
+  }
+  return true;
+}
+
+void StreamViewer::disconnect()
+{
+  if (fd >= 0)
+    close(fd);
+  fd = -1;
+  haveHello = false;
+  buffer.clear();
+}
+
+bool StreamViewer::poll()
+{
+  if (fd < 0)
+    return false;
+
+  bool open = true;
+  char chunk[65536];
+  for (;;)
+  {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n > 0)
+    {
+      buffer.append(chunk, n);
+      received += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      open = false;
+    break;
+  }
+
+  size_t at = 0;
+  if (!haveHello && buffer.size() >= sizeof(StreamHello))
+  {
+    memcpy(&header, buffer.data(), sizeof(header));
+    if (header.magic != STREAM_MAGIC || header.version != STREAM_VERSION)
+    {
+      disconnect();
+      return false;
+    }
+    decoder.reset(header);
+    haveHello = true;
+    at = sizeof(header);
+  }
+
+  //Deltas against a keyframe this viewer missed are passed over, but a
+  //keyframe that doesn't fit the hello means the stream is broken
+  while (haveHello && buffer.size() - at >= sizeof(StreamFrame))
+  {
+    StreamFrame frame;
+    memcpy(&frame, buffer.data() + at, sizeof(frame));
+    if (frame.size > STREAM_MAX_FRAME)
+    {
+      disconnect();
+      return false;
+    }
+    if (buffer.size() - at - sizeof(frame) < frame.size)
+      break;
+    at += sizeof(frame);
+    if (!decoder.decode(frame, (const unsigned char*)buffer.data() + at) && frame.tick == frame.keyTick)
+    {
+      disconnect();
+      return false;
+    }
+    at += frame.size;
+  }
+  buffer.erase(0, at);
+
+  if (!open)
+    disconnect();
+  return open;
+}
+
+bool parseStreamOption(int argc, char** argv, int* a, StreamOptions* options)
+{
+  const char* value;
+  if ((value = optionValue(argc, argv, a, "--stream")))
+    options->port = atoi(value);
+  else if (strcmp(argv[*a], "--loopback") == 0)
+    options->loopback = true;
+  else if ((value = optionValue(argc, argv, a, "--view")))
+    options->view = value;
+  else
+    return false;
+  return true;
+}
+
+int runStreamHeadless(const HeadlessOptions& options, const StreamOptions& stream)
+{
+  if (!checkRunOptions(options, CHECK_RUN))
+    return -1;
+
+  std::vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &points, &segments))
+    return -1;
+  VelocityProfile profile(points, segments);
+  FrameTable frames(points);
+
+  std::vector<Train> trains;
+  float L = profile.trackLength();
+  float startArcLength = profile.sampleArcLength(segments.start());
+  for (int t = 0; t < options.trains; t++)
+  {
+    trains.push_back(Train(profile, startArcLength + t * L / options.trains, options.cars, CAR_COUPLING));
+  }
+
+  StreamHello hello;
+  hello.trains = options.trains;
+  hello.trackChecksum = checksumTrack(points, profile);
+  hello.simRate = options.simRate;
+  hello.trackLength = L;
+  hello.keyframeInterval = STREAM_KEYFRAME_INTERVAL;
+  StreamServer server;
+  if (!server.listen(stream.port, hello))
+  {
+    printf("ERROR: unable to listen on port %d \n", stream.port);
+    return -1;
+  }
+
+  StreamViewer viewer;
+  if (stream.loopback && !viewer.connect("127.0.0.1:" + std::to_string(server.port())))
+  {
+    printf("ERROR: unable to connect to port %d \n", server.port());
+    return -1;
+  }
+  printf("streaming:        %d trains on %s (%.2f m) at %.0f Hz on port %d%s \n", options.trains,
+         options.track.c_str(), L, options.simRate, server.port(), stream.loopback ? " to a loopback viewer" : "");
+  fflush(stdout);
+
+  const double simDt = 1.0 / options.simRate;
+  long long steps = (long long)(options.seconds * options.simRate);
+  double maxArcError = 0.0, maxPositionError = 0.0;
+  long long stageErrors = 0;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Clock::time_point lastReport = start;
+  uint64_t lastBytes = 0;
+  for (long long n = 0; n < steps; n++)
+  {
+    for (size_t t = 0; t < trains.size(); t++)
+    {
+      trains[t].step(simDt);
+    }
+    server.publish(n, trains);
+
+    if (stream.loopback)
+    {
+      //Wait for this tick to come out the other end, then compare
+      const StreamDecoder& seen = viewer.state();
+      while (!seen.hasState() || seen.tick() != n)
+      {
+        server.flush();
+        if (!viewer.poll())
+        {
+          printf("ERROR: the loopback viewer lost the stream at step %lld \n", n);
+          return -1;
+        }
+      }
+      for (size_t t = 0; t < trains.size(); t++)
+      {
+        float ds = seen.trainArcLength(t) - trains[t].arcLength();
+        ds -= L * floor(ds / L + 0.5f);
+        maxArcError = std::max(maxArcError, (double)fabs(ds));
+        maxPositionError = std::max(maxPositionError, (double)length(frames.positionAt(seen.trainArcLength(t)) -
+                                                                     frames.positionAt(trains[t].arcLength())));
+        stageErrors += (seen.trainStage(t) != trains[t].stage());
+      }
+      continue;
+    }
+
+    //Live, one step per tick of the wall clock
+    std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>((n + 1) * simDt)));
+    Clock::time_point now = Clock::now();
+    if (std::chrono::duration<double>(now - lastReport).count() >= 1.0)
+    {
+      double since = std::chrono::duration<double>(now - lastReport).count();
+      printf("%6.0f s: %d viewers, %.1f KB/s \n", (n + 1) * simDt, server.viewers(),
+             (server.bytesEncoded() - lastBytes) / 1024.0 / since);
+      fflush(stdout);
+      lastReport = now;
+      lastBytes = server.bytesEncoded();
+    }
+  }
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  double trainTicks = (double)server.frames() * options.trains;
+  uint64_t deltaBytes = server.bytesEncoded() - server.keyframeBytes();
+  uint64_t deltaFrames = server.frames() - server.keyframes();
+  printf("frames:           %llu (%llu keyframes, every %d steps), %.1f KB in %.3f s \n",
+         (unsigned long long)server.frames(), (unsigned long long)server.keyframes(), STREAM_KEYFRAME_INTERVAL,
+         server.bytesEncoded() / 1024.0, wallSeconds);
+  printf("bytes per train:  %.2f per tick, %.2f in keyframes, %.2f in deltas (raw state %d) \n",
+         server.bytesEncoded() / trainTicks, server.keyframeBytes() / std::max(1.0, (double)server.keyframes() * options.trains),
+         deltaBytes / std::max(1.0, (double)deltaFrames * options.trains), (int)(sizeof(float) + 1));
+  printf("bandwidth:        %.1f KB/s per viewer at %.0f Hz \n", server.bytesEncoded() / 1024.0 / options.seconds,
+         options.simRate);
+  if (stream.loopback)
+  {
+    printf("loopback:         %llu bytes received, max error %.2f mm along the track, %.2f mm in position, "
+           "%lld stage errors \n", (unsigned long long)viewer.bytesReceived(), 1e3 * maxArcError,
+           1e3 * maxPositionError, stageErrors);
+  } else
+  {
+    printf("viewers:          %d connected at the end, %llu frames skipped for slow ones \n", server.viewers(),
+           (unsigned long long)server.framesSkipped());
+  }
+
+  return 0;
+}
+
+int runViewHeadless(const HeadlessOptions& options, const StreamOptions& stream)
+{
+  std::vector<vec3> points;
+  TrackSegments segments;
+  if (!loadTrack(options.track, &points, &segments))
+    return -1;
+  VelocityProfile profile(points, segments);
+  FrameTable frames(points);
+
+  StreamViewer viewer;
+  if (!viewer.connect(stream.view))
+  {
+    printf("ERROR: unable to connect to %s \n", stream.view.c_str());
+    return -1;
+  }
+
+  const char* stageNames[STAGE_COUNT] = { "lifting", "free fall", "deceleration" };
+  const StreamDecoder& seen = viewer.state();
+  bool checked = false;
+  uint64_t lastBytes = 0;
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point lastReport = Clock::now();
+  while (viewer.poll())
+  {
+    if (viewer.hasHello() && !checked)
+    {
+      if (viewer.hello().trackChecksum != checksumTrack(points, profile))
+      {
+        printf("ERROR: %s is streaming a different track from %s \n", stream.view.c_str(), options.track.c_str());
+        return -1;
+      }
+      printf("watching:         %u trains on %s at %.0f Hz \n", viewer.hello().trains, options.track.c_str(),
+             viewer.hello().simRate);
+      checked = true;
+    }
+
+    Clock::time_point now = Clock::now();
+    double since = std::chrono::duration<double>(now - lastReport).count();
+    if (seen.hasState() && since >= 1.0)
+    {
+      vec3 p = frames.positionAt(seen.trainArcLength(0));
+      printf("step %u: %.1f KB/s, %.2f bytes per train per step, train 0 at %.2f m (%.2f, %.2f, %.2f) %s \n",
+             seen.tick(), (viewer.bytesReceived() - lastBytes) / 1024.0 / since,
+             (viewer.bytesReceived() - lastBytes) / (since * viewer.hello().simRate * seen.numTrains()),
+             seen.trainArcLength(0), p.x, p.y, p.z, stageNames[seen.trainStage(0) % STAGE_COUNT]);
+      fflush(stdout);
+      lastReport = now;
+      lastBytes = viewer.bytesReceived();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  printf("stream ended:     %llu bytes received \n", (unsigned long long)viewer.bytesReceived());
+  return 0;
+}
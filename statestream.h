@@ -0,0 +1,200 @@
+#ifndef STATESTREAM_H
+#define STATESTREAM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "headless.h"
+#include "train.h"
+
+//Live train positions for viewers on other machines. Every tick the
+//server sends each train's arc length and stage; viewers load the same
+//track and turn arc lengths into positions themselves.
+//
+//Arc lengths are quantized to 16 bits of a lap (under half a millimetre
+//on the tracks here). A keyframe sends every train's position and how far
+//it moved in the last tick, 5 bytes a train. The ticks after it only send
+//how far each train is from where that movement predicts, as a varint
+//with the stage in its low two bits, which is one or two bytes a train.
+//Every delta frame only depends on the last keyframe, so a viewer that
+//falls behind can skip to the next one.
+//
+//The stream starts with a StreamHello and then is a StreamFrame header
+//followed by its payload for every tick, in native byte order.
+struct StreamHello {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t trains;
+  uint32_t trackChecksum;   //see checksumTrack, so a viewer can tell it has the right track
+  double simRate;
+  float trackLength;
+  uint32_t keyframeInterval;
+};
+
+struct StreamFrame {
+  uint32_t size;            //payload bytes
+  uint32_t tick;
+  uint32_t keyTick;         //the keyframe this one is relative to, tick for a keyframe
+};
+
+//Ticks from one keyframe to the next
+const int STREAM_KEYFRAME_INTERVAL = 30;
+
+//Turns train states into frames, keeping the last keyframe
+class StreamEncoder {
+public:
+  StreamEncoder(int trains, float trackLength, int keyframeInterval = STREAM_KEYFRAME_INTERVAL);
+
+  //Appends the frame for tick to out. Returns true if it is a keyframe.
+  bool encode(uint32_t tick, const float* arcLength, const uint8_t* stage, std::string* out);
+
+private:
+  uint16_t quantize(float s) const;
+
+  int count;
+  float scale;              //quantized units per metre
+  int interval;
+  uint32_t keyTick;
+  bool haveKey;
+  std::vector<uint16_t> previous;   //last tick's quantized positions
+  std::vector<uint16_t> keyPosition;
+  std::vector<int16_t> keyStep;     //movement per tick at the keyframe
+};
+
+//Rebuilds train states from frames
+class StreamDecoder {
+public:
+  StreamDecoder(): length(0.f), tickNow(0), keyTick(0), haveKey(false), haveState(false) {}
+
+  void reset(const StreamHello& hello);
+
+  //Decodes one frame. Returns false if it is malformed or relative to a
+  //keyframe this decoder didn't see, leaving the last state in place.
+  bool decode(const StreamFrame& frame, const unsigned char* payload);
+
+  bool hasState() const { return haveState; }
+  uint32_t tick() const { return tickNow; }
+  int numTrains() const { return arcLength.size(); }
+  float trainArcLength(int i) const { return arcLength[i]; }
+  RideStage trainStage(int i) const { return (RideStage)stage[i]; }
+
+private:
+  float length;
+  uint32_t tickNow;
+  uint32_t keyTick;
+  bool haveKey;
+  bool haveState;
+  std::vector<uint16_t> keyPosition;
+  std::vector<int16_t> keyStep;
+  std::vector<float> arcLength;
+  std::vector<uint8_t> stage;
+};
+
+//Publishes the trains to every viewer connected over TCP. Nothing here
+//blocks: frames a viewer can't take yet are queued, and once too much is
+//queued it misses delta frames until the next keyframe.
+class StreamServer {
+public:
+  StreamServer();
+  ~StreamServer();
+
+  //Listens on port, 0 for any free one. Returns false if it can't.
+  bool listen(int port, const StreamHello& hello);
+  int port() const { return listenPort; }
+
+  //Accepts new viewers, then encodes the tick once and sends it to all
+  void publish(uint32_t tick, const std::vector<Train>& trains);
+
+  //Sends what is still queued
+  void flush();
+
+  int viewers() const { return clients.size(); }
+  uint64_t keyframes() const { return keyCount; }
+  uint64_t frames() const { return frameCount; }
+  uint64_t bytesEncoded() const { return encoded; }
+  uint64_t keyframeBytes() const { return keyBytes; }
+  //Frames a viewer missed by falling behind, not counting the wait for the
+  //first keyframe when it joins
+  uint64_t framesSkipped() const { return skipped; }
+
+private:
+  StreamServer(const StreamServer&);
+  StreamServer& operator=(const StreamServer&);
+
+  struct Client {
+    int fd;
+    std::string pending;
+    bool needKey;           //new or skipped a frame, waiting for the next keyframe
+    bool started;           //has been sent a keyframe
+  };
+
+  void accept();
+  bool send(Client* client);
+
+  int listener;
+  int listenPort;
+  StreamHello header;
+  StreamEncoder* encoder;
+  std::vector<Client> clients;
+  std::vector<float> arcLength;
+  std::vector<uint8_t> stage;
+  std::string frame;
+  uint64_t keyCount, frameCount, encoded, keyBytes, skipped;
+};
+
+//The other end of a StreamServer
+class StreamViewer {
+public:
+  StreamViewer(): fd(-1), haveHello(false), received(0) {}
+  ~StreamViewer() { disconnect(); }
+
+  //Returns false if it can't connect
+  bool connect(const std::string& address);
+  void disconnect();
+
+  //Reads and decodes whatever has arrived without waiting for more.
+  //Returns false once the server has gone away or sent something broken.
+  bool poll();
+
+  bool hasHello() const { return haveHello; }
+  const StreamHello& hello() const { return header; }
+  const StreamDecoder& state() const { return decoder; }
+  uint64_t bytesReceived() const { return received; }
+
+private:
+  StreamViewer(const StreamViewer&);
+  StreamViewer& operator=(const StreamViewer&);
+
+  int fd;
+  bool haveHello;
+  StreamHello header;
+  StreamDecoder decoder;
+  std::string buffer;
+  uint64_t received;
+};
+
+//Settings for runStreamHeadless and runViewHeadless
+struct StreamOptions {
+  int port;                 //TCP port to publish the trains on, -1 for none, 0 for any free one
+  bool loopback;            //check the stream with a local viewer instead of running in real time
+  std::string view;         //host:port of a stream to watch
+
+  StreamOptions(): port(-1), loopback(false) {}
+};
+
+//Reads --stream, --loopback and --view, see parseRunOption
+bool parseStreamOption(int argc, char** argv, int* a, StreamOptions* options);
+
+//Publishes options.trains trains on options.track to viewers on
+//stream.port every step, in real time. With stream.loopback it runs as
+//fast as possible with a viewer on the same machine instead, checks what
+//it decodes against the trains and prints the bandwidth and the position
+//error.
+int runStreamHeadless(const HeadlessOptions& options, const StreamOptions& stream);
+
+//Watches the stream at stream.view, rebuilding the train positions from
+//options.track, and prints what arrives once a second until it ends
+int runViewHeadless(const HeadlessOptions& options, const StreamOptions& stream);
+
+#endif
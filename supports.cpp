@@ -0,0 +1,204 @@
+#include "supports.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+//Parts of the track closer than this many column widths plus gaps along
+//it are the part the column holds up, not something in its way
+const float SUPPORT_NEAR_FACTOR = 2.f;
+
+//Track segments bucketed by the ground cells they pass over, so that
+//checking what is under a column only looks at the segments nearby
+class SegmentGrid {
+public:
+  SegmentGrid(const FrameTable& frames, float cellSize, float margin): cell(cellSize)
+  {
+    int size = frames.size();
+    for (int k = 0; k < size; k++)
+    {
+      vec3 a = frames.samplePosition(k);
+      vec3 b = frames.samplePosition((k + 1) % size);
+      int x0 = cellOf(std::min(a.x, b.x) - margin), x1 = cellOf(std::max(a.x, b.x) + margin);
+      int z0 = cellOf(std::min(a.z, b.z) - margin), z1 = cellOf(std::max(a.z, b.z) + margin);
+      for (int x = x0; x <= x1; x++)
+        for (int z = z0; z <= z1; z++)
+          cells[key(x, z)].push_back(k);
+    }
+  }
+
+  //Segments within margin of x, z, or null if there are none
+  const std::vector<int>* near(float x, float z) const
+  {
+    std::unordered_map<int64_t, std::vector<int> >::const_iterator found = cells.find(key(cellOf(x), cellOf(z)));
+    return found == cells.end() ? 0 : &found->second;
+  }
+
+private:
+  int cellOf(float v) const { return (int)floor(v / cell); }
+  static int64_t key(int x, int z) { return ((int64_t)x << 32) ^ (uint32_t)z; }
+
+  float cell;
+  std::unordered_map<int64_t, std::vector<int> > cells;
+};
+
+int generateSupports(const FrameTable& frames, const SupportOptions& options, const GroundHeight& ground,
+                     std::vector<mat4>* out)
+{
+  out->clear();
+  int size = frames.size();
+  float L = frames.trackLength();
+  if (size < 2 || L <= 0.f || options.spacing <= 0.f)
+    return 0;
+
+  float radius = 0.5f * options.width + options.gap;
+  float nearby = SUPPORT_NEAR_FACTOR * (options.width + options.gap);
+  SegmentGrid grid(frames, std::max(2.f * radius, L / size), radius);
+
+  int count = (int)(L / options.spacing);
+  out->reserve(count);
+  for (int n = 0; n < count; n++)
+  {
+    float s = n * options.spacing;
+    vec3 p = frames.positionAt(s);
+    vec3 up = frames.orientationAt(s) * vec3(0.f, 1.f, 0.f);
+    if (up.y < 0.f)
+      continue;
+
+    float foot = ground(p.x, p.z);
+    float top = p.y - options.gap;
+    if (top - foot < options.minHeight)
+      continue;
+
+    //Any other part of the track passing through the column, between its
+    //foot and its top, rules it out
+    bool blocked = false;
+    const std::vector<int>* segments = grid.near(p.x, p.z);
+    for (size_t i = 0; segments && i < segments->size() && !blocked; i++)
+    {
+      int k = (*segments)[i];
+      float along = fabs(frames.sampleArcLength(k) - s);
+      if (std::min(along, L - along) < nearby)
+        continue;
+
+      vec3 a = frames.samplePosition(k);
+      vec3 b = frames.samplePosition((k + 1) % size);
+      vec2 ab(b.x - a.x, b.z - a.z);
+      vec2 ap(p.x - a.x, p.z - a.z);
+      float ab2 = dot(ab, ab);
+      float t = ab2 > 0.f ? clamp(dot(ap, ab) / ab2, 0.f, 1.f) : 0.f;
+      vec2 d = ap - t * ab;
+      float y = a.y + t * (b.y - a.y);
+      blocked = dot(d, d) < radius * radius && y < top + options.gap && y > foot;
+    }
+    if (blocked)
+      continue;
+
+    mat4 column = translate(mat4(1.f), vec3(p.x, foot, p.z));
+    out->push_back(scale(column, vec3(options.width, top - foot, options.width)));
+  }
+  return out->size();
+}
+
+bool parseSupportOption(int argc, char** argv, int* a, SupportOptions* options)
+{
+  const char* value = optionValue(argc, argv, a, "--support-spacing");
+  if (!value)
+    return false;
+  options->spacing = atof(value);
+  return true;
+}
+
+int runSupportsHeadless(const HeadlessOptions& options, const SupportOptions& supportOptions)
+{
+  if (!checkRunOptions(options, CHECK_COPIES))
+    return -1;
+  if (supportOptions.spacing <= 0.f)
+  {
+    printf("ERROR: --support-spacing must be positive \n");
+    return -1;
+  }
+
+  std::vector<std::string> files = options.tracks;
+  if (files.empty())
+    files.push_back(options.track);
+
+  std::vector<FrameTable*> tables;
+  for (size_t f = 0; f < files.size(); f++)
+  {
+    std::vector<vec3> points;
+    TrackSegments segments;
+    if (!loadTrack(files[f], &points, &segments))
+    {
+      for (size_t t = 0; t < tables.size(); t++)
+        delete tables[t];
+      return -1;
+    }
+    tables.push_back(new FrameTable(points));
+  }
+
+  //Every copy is generated again, as a park with that many coasters
+  //would, and its columns kept for the upload below
+  typedef std::chrono::steady_clock Clock;
+  GroundHeight plane = [](float, float) { return GROUND_PLANE_HEIGHT; };
+  int numTracks = files.size() * options.copies;
+  std::vector<std::vector<mat4> > supports(numTracks);
+  double totalSeconds = 0.0, worstSeconds = 0.0;
+  long long columns = 0;
+  float trackLength = 0.f;
+  printf("spacing:          %.2f m \n", supportOptions.spacing);
+  for (size_t f = 0; f < files.size(); f++)
+  {
+    double fileSeconds = 0.0;
+    for (int c = 0; c < options.copies; c++)
+    {
+      std::vector<mat4>& out = supports[f * options.copies + c];
+      Clock::time_point start = Clock::now();
+      generateSupports(*tables[f], supportOptions, plane, &out);
+      double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      fileSeconds += seconds;
+      worstSeconds = std::max(worstSeconds, seconds);
+      columns += out.size();
+      trackLength += tables[f]->trackLength();
+    }
+    totalSeconds += fileSeconds;
+    printf("%-17s %.1f m, %d columns, %.3f ms a copy \n", (files[f] + ":").c_str(), tables[f]->trackLength(),
+           (int)supports[f * options.copies].size(), 1e3 * fileSeconds / options.copies);
+  }
+
+  //The window copies each track's columns into a static vertex buffer
+  //once and then draws them with one instanced call a frame, so that
+  //upload is all the CPU side of drawing them costs
+  std::vector<mat4> instances(std::max(columns, 1LL));
+  Clock::time_point start = Clock::now();
+  size_t offset = 0;
+  for (int t = 0; t < numTracks; t++)
+  {
+    if (!supports[t].empty())
+      memcpy(&instances[offset], &supports[t][0], supports[t].size() * sizeof(mat4));
+    offset += supports[t].size();
+  }
+  double uploadSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+  double bytes = (double)columns * sizeof(mat4);
+
+  printf("tracks:           %d (%d files x %d copies), %.0f m of track \n", numTracks, (int)files.size(),
+         options.copies, trackLength);
+  printf("columns:          %lld, %.2f per metre \n", columns, columns / std::max(trackLength, 1.f));
+  printf("generation:       %.2f ms, %.0f ns per column, worst track %.3f ms \n", 1e3 * totalSeconds,
+         1e9 * totalSeconds / std::max(columns, 1LL), 1e3 * worstSeconds);
+  printf("instance data:    %.2f MB, copied in %.2f ms, uploaded once \n", bytes / 1048576.0,
+         1e3 * uploadSeconds);
+  printf("draw:             %d instanced calls a frame, one per track \n", numTracks);
+  printf("peak memory:      %.1f MB \n", peakMemoryMB());
+
+  for (size_t t = 0; t < tables.size(); t++)
+    delete tables[t];
+  return 0;
+}
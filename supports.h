@@ -0,0 +1,50 @@
+#ifndef SUPPORTS_H
+#define SUPPORTS_H
+
+#include <functional>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "frametable.h"
+#include "headless.h"
+
+using namespace glm;
+
+//Height of the ground under x, z, so columns can stand on terrain
+typedef std::function<float(float x, float z)> GroundHeight;
+
+//Height of the generatePlane quad the track stands on
+const float GROUND_PLANE_HEIGHT = -1.f;
+
+//Settings for generateSupports, in the curve's metres
+struct SupportOptions {
+  float spacing;            //arc length from one column to the next
+  float width;              //column cross section
+  float gap;                //room left between the top of a column and the curve, and around it
+  float minHeight;          //shorter columns are left out
+
+  SupportOptions(): spacing(1.f), width(0.08f), gap(0.1f), minHeight(0.05f) {}
+};
+
+//Places a column every options.spacing of arc length along the track,
+//standing on the ground straight below the curve and reaching up to
+//options.gap under it. Each column is a model matrix for a unit column
+//(x and z from -0.5 to 0.5, y from 0 to 1) scaled to its width and
+//height and moved to its foot, ready for an instanced draw.
+//
+//Nothing is placed where the track is upside down, or where another part
+//of the track passes through the column further down. Returns the number
+//of columns written to out.
+int generateSupports(const FrameTable& frames, const SupportOptions& options, const GroundHeight& ground,
+                     std::vector<mat4>* out);
+
+//Reads --support-spacing, see parseRunOption
+bool parseSupportOption(int argc, char** argv, int* a, SupportOptions* options);
+
+//Generates the columns every supports.spacing for each of options.copies
+//copies of every --track, the way the window builds them, and prints the
+//time taken and the instance data they upload
+int runSupportsHeadless(const HeadlessOptions& options, const SupportOptions& supports);
+
+#endif
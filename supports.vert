@@ -0,0 +1,21 @@
+// ==========================================================================
+// Vertex program for the support columns, all drawn in one instanced call
+// ==========================================================================
+#version 410
+
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec3 VertexNormal;
+
+//From generateSupports, one per instance
+layout(location = 2) in mat4 SupportTransform;
+
+layout(std140) uniform FrameBlock { mat4 viewProjectionMatrix; };
+layout(std140) uniform ObjectBlock { mat4 modelMatrix; };
+
+out vec3 FragNormal;
+
+void main()
+{
+	FragNormal = VertexNormal;
+	gl_Position = viewProjectionMatrix * modelMatrix * SupportTransform * vec4(VertexPosition, 1.0);
+}
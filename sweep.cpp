@@ -0,0 +1,305 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "forceprofile.h"
+#include "frametable.h"
+#include "track.h"
+
+//Runs per work item. Items are merged in order, so this only trades
+//scheduling overhead against how often progress is reported.
+const long long SWEEP_CHUNK = 256;
+
+float* SweepParameter::field(RideParameters* params) const
+{
+  if (name == "friction")
+    return &params->friction;
+  if (name == "mass")
+    return &params->mass;
+  if (name == "drag")
+    return &params->dragArea;
+  if (name == "boost")
+    return &params->boost;
+  if (name == "brake-boost")
+    return &params->brakeBoost;
+  if (name == "brake-decel")
+    return &params->brakeDeceleration;
+  return 0;
+}
+
+static bool parseFloat(const std::string& text, float* out)
+{
+  char* end = 0;
+  *out = strtof(text.c_str(), &end);
+  return !text.empty() && *end == '\0';
+}
+
+bool parseSweepParameter(const std::string& spec, SweepParameter* out)
+{
+  size_t eq = spec.find('=');
+  if (eq == std::string::npos)
+    return false;
+
+  RideParameters probe;
+  out->name = spec.substr(0, eq);
+  if (!out->field(&probe))
+    return false;
+
+  std::string value = spec.substr(eq + 1);
+  if (value.compare(0, 7, "normal:") == 0)
+  {
+    size_t colon = value.find(':', 7);
+    out->kind = SweepParameter::NORMAL;
+    return colon != std::string::npos && parseFloat(value.substr(7, colon - 7), &out->a) &&
+           parseFloat(value.substr(colon + 1), &out->b) && out->b >= 0.f;
+  }
+
+  size_t colon = value.find(':');
+  if (colon == std::string::npos)
+  {
+    out->kind = SweepParameter::FIXED;
+    out->b = 0.f;
+    return parseFloat(value, &out->a);
+  }
+  out->kind = SweepParameter::UNIFORM;
+  return parseFloat(value.substr(0, colon), &out->a) && parseFloat(value.substr(colon + 1), &out->b) &&
+         out->a <= out->b;
+}
+
+void RunningStats::add(double x)
+{
+  min = count ? std::min(min, x) : x;
+  max = count ? std::max(max, x) : x;
+  count++;
+  double d = x - mean;
+  mean += d / count;
+  m2 += d * (x - mean);
+}
+
+void RunningStats::merge(const RunningStats& other)
+{
+  if (other.count == 0)
+    return;
+  if (count == 0)
+  {
+    *this = other;
+    return;
+  }
+  long long n = count + other.count;
+  double d = other.mean - mean;
+  mean += d * other.count / n;
+  m2 += other.m2 + d * d * count * other.count / n;
+  min = std::min(min, other.min);
+  max = std::max(max, other.max);
+  count = n;
+}
+
+double RunningStats::stddev() const
+{
+  return (count > 1) ? sqrt(m2 / (count - 1)) : 0.0;
+}
+
+void RunningCorrelation::add(double x, double y)
+{
+  count++;
+  double dx = x - meanX;
+  meanX += dx / count;
+  double dy = y - meanY;
+  meanY += dy / count;
+  m2X += dx * (x - meanX);
+  m2Y += dy * (y - meanY);
+  c += dx * (y - meanY);
+}
+
+void RunningCorrelation::merge(const RunningCorrelation& other)
+{
+  if (other.count == 0)
+    return;
+  if (count == 0)
+  {
+    *this = other;
+    return;
+  }
+  long long n = count + other.count;
+  double dx = other.meanX - meanX;
+  double dy = other.meanY - meanY;
+  double w = (double)count * other.count / n;
+  meanX += dx * other.count / n;
+  meanY += dy * other.count / n;
+  m2X += other.m2X + dx * dx * w;
+  m2Y += other.m2Y + dy * dy * w;
+  c += other.c + dx * dy * w;
+  count = n;
+}
+
+double RunningCorrelation::correlation() const
+{
+  return (m2X > 0.0 && m2Y > 0.0) ? c / sqrt(m2X * m2Y) : 0.0;
+}
+
+void SweepStats::merge(const SweepStats& other)
+{
+  runs += other.runs;
+  stalled += other.stalled;
+  braked += other.braked;
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    metric[m].merge(other.metric[m]);
+  }
+  parameter.resize(other.parameter.size());
+  for (size_t p = 0; p < other.parameter.size(); p++)
+  {
+    parameter[p].merge(other.parameter[p]);
+  }
+  correlation.resize(other.correlation.size());
+  for (size_t k = 0; k < other.correlation.size(); k++)
+  {
+    correlation[k].merge(other.correlation[k]);
+  }
+}
+
+//Seconds from the top until the cart comes to rest or gets back round
+static double rideTime(const VelocityProfile& profile, int start, int size)
+{
+  float stop = profile.stopArcLength();
+  double t = 0.0;
+  for (int n = 0; n < size; n++)
+  {
+    int k = (start + n) % size;
+    int next = (k + 1) % size;
+    float s0 = profile.sampleArcLength(k);
+    if (stop >= 0.f && s0 == stop)
+      break;
+    float ds = ((k + 1 < size) ? profile.sampleArcLength(k + 1) : profile.trackLength()) - s0;
+    t += 0.5 * ds * (1.0 / profile.velocityAt(s0) + 1.0 / profile.velocityAt(profile.sampleArcLength(next)));
+  }
+  return t;
+}
+
+unsigned long long runSeed(unsigned long long seed, long long run)
+{
+  unsigned long long z = seed + 0x9E3779B97F4A7C15ull * (unsigned long long)(run + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+SweepStats runSweep(const std::vector<vec3>& points, const TrackSegments& segments,
+                    const std::vector<SweepParameter>& params,
+                    long long runs, unsigned long long seed, int numThreads,
+                    std::function<void(const SweepStats&)> progress)
+{
+  //The frames only depend on the track, so every run shares them
+  FrameTable frames(points);
+  int start = segments.start();
+  int numParams = params.size();
+
+  long long numChunks = (runs + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+  std::vector<SweepStats> chunks(numChunks);
+  std::vector<char> done(numChunks, 0);
+
+  std::mutex mutex;
+  SweepStats total;
+  long long merged = 0;     //chunks before this one are in total
+  std::atomic<long long> next(0);
+
+  if (numThreads <= 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  numThreads = (int)std::max(1LL, std::min((long long)numThreads, numChunks));
+
+  auto work = [&]() {
+    std::vector<ForceSample> samples;
+    std::vector<float> drawn(numParams);
+    for (long long c = next++; c < numChunks; c = next++)
+    {
+      SweepStats& stats = chunks[c];
+      stats.parameter.resize(numParams);
+      stats.correlation.resize(numParams * METRIC_COUNT);
+
+      long long end = std::min(runs, (c + 1) * SWEEP_CHUNK);
+      for (long long r = c * SWEEP_CHUNK; r < end; r++)
+      {
+        std::mt19937_64 random(runSeed(seed, r));
+        RideParameters ride;
+        for (int p = 0; p < numParams; p++)
+        {
+          const SweepParameter& sp = params[p];
+          float value = sp.a;
+          if (sp.kind == SweepParameter::UNIFORM)
+            value = std::uniform_real_distribution<float>(sp.a, sp.b)(random);
+          else if (sp.kind == SweepParameter::NORMAL && sp.b > 0.f)
+            value = std::normal_distribution<float>(sp.a, sp.b)(random);
+          *sp.field(&ride) = value;
+          drawn[p] = value;
+          stats.parameter[p].add(value);
+        }
+
+        VelocityProfile profile(points, segments, ride);
+        computeForceProfile(points, profile, frames, &samples);
+
+        double value[METRIC_COUNT];
+        bool measured[METRIC_COUNT];
+        double peak = samples[0].gVertical;
+        for (size_t k = 1; k < samples.size(); k++)
+        {
+          peak = std::max(peak, (double)samples[k].gVertical);
+        }
+        bool stops = profile.stopArcLength() >= 0.f;
+        value[METRIC_RIDE_TIME] = rideTime(profile, start, points.size());
+        measured[METRIC_RIDE_TIME] = !stops || profile.stopStage() != STAGE_FREE_FALL;
+        value[METRIC_PEAK_G] = peak;
+        measured[METRIC_PEAK_G] = true;
+        value[METRIC_STOP] = profile.stopArcLength();
+        measured[METRIC_STOP] = stops;
+
+        stats.runs++;
+        if (stops && profile.stopStage() == STAGE_FREE_FALL)
+          stats.stalled++;
+        else if (stops)
+          stats.braked++;
+        for (int m = 0; m < METRIC_COUNT; m++)
+        {
+          if (!measured[m])
+            continue;
+          stats.metric[m].add(value[m]);
+          for (int p = 0; p < numParams; p++)
+          {
+            stats.correlation[p * METRIC_COUNT + m].add(drawn[p], value[m]);
+          }
+        }
+      }
+
+      //Fold finished chunks into the total in order and drop them
+      std::lock_guard<std::mutex> lock(mutex);
+      done[c] = 1;
+      bool advanced = false;
+      while (merged < numChunks && done[merged])
+      {
+        total.merge(chunks[merged]);
+        chunks[merged] = SweepStats();
+        merged++;
+        advanced = true;
+      }
+      if (advanced && progress)
+        progress(total);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numThreads; t++)
+  {
+    workers.push_back(std::thread(work));
+  }
+  for (size_t t = 0; t < workers.size(); t++)
+  {
+    workers[t].join();
+  }
+
+  return total;
+}
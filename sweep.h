@@ -0,0 +1,92 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "velocityprofile.h"
+
+using namespace glm;
+
+//One RideParameters field and how the sweep picks it for each run
+struct SweepParameter {
+  enum Kind { FIXED, UNIFORM, NORMAL };
+
+  std::string name;   //friction, mass, drag, boost, brake-boost or brake-decel
+  Kind kind;
+  float a;            //value, low end or mean
+  float b;            //high end or standard deviation
+
+  float* field(RideParameters* params) const;
+};
+
+//Parses "name=value", "name=low:high" (uniform) or "name=normal:mean:sd".
+//Returns false on an unknown name or bad numbers.
+bool parseSweepParameter(const std::string& spec, SweepParameter* out);
+
+//Mean, spread and range of a stream of values, mergeable across threads
+struct RunningStats {
+  long long count;
+  double mean;
+  double m2;
+  double min;
+  double max;
+
+  RunningStats(): count(0), mean(0.0), m2(0.0), min(0.0), max(0.0) {}
+  void add(double x);
+  void merge(const RunningStats& other);
+  double stddev() const;
+};
+
+//Streamed correlation between two values, mergeable across threads
+struct RunningCorrelation {
+  long long count;
+  double meanX, meanY;
+  double m2X, m2Y, c;
+
+  RunningCorrelation(): count(0), meanX(0.0), meanY(0.0), m2X(0.0), m2Y(0.0), c(0.0) {}
+  void add(double x, double y);
+  void merge(const RunningCorrelation& other);
+  double correlation() const;
+};
+
+//What the sweep measures on every run
+enum SweepMetric {
+  METRIC_RIDE_TIME = 0,   //top to rest or back round to the top, not counting stalls
+  METRIC_PEAK_G,          //largest vertical g
+  METRIC_STOP,            //arc length the cart comes to rest at, only runs that stop
+  METRIC_COUNT
+};
+
+struct SweepStats {
+  long long runs;
+  long long stalled;      //came to rest in free fall
+  long long braked;       //stopped by the brakes
+  RunningStats metric[METRIC_COUNT];
+  std::vector<RunningStats> parameter;
+  //correlation of every parameter with every metric, parameter major
+  std::vector<RunningCorrelation> correlation;
+
+  SweepStats(): runs(0), stalled(0), braked(0) {}
+  void merge(const SweepStats& other);
+};
+
+//Seed for run number run of a search started from seed. Spreads the bits
+//of the run index so neighbouring runs get unrelated seeds.
+unsigned long long runSeed(unsigned long long seed, long long run);
+
+//Runs runs ride profiles on the track with parameters drawn from params,
+//all starting from segments.start(),
+//spread over numThreads threads (0 uses one per core). Run r always draws
+//from the same seed, and runs are merged in a fixed order, so the result
+//doesn't depend on the number of threads. progress, if set, is called
+//from one thread at a time with the statistics of the runs finished so far.
+SweepStats runSweep(const std::vector<vec3>& points, const TrackSegments& segments,
+                    const std::vector<SweepParameter>& params,
+                    long long runs, unsigned long long seed, int numThreads,
+                    std::function<void(const SweepStats&)> progress = nullptr);
+
+#endif
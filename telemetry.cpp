@@ -0,0 +1,199 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+const uint32_t TELEMETRY_FILE_MAGIC = 0x594d4c54;   //"TLMY"
+const uint32_t TELEMETRY_FILE_VERSION = 1;
+const uint64_t TELEMETRY_HEADER_SIZE = 32;
+
+//Bytes of the file mapped at a time, a multiple of the page and record sizes
+const uint64_t TELEMETRY_WINDOW = 16 << 20;
+
+//Records the writer thread takes off the ring at once
+const size_t TELEMETRY_BATCH = 4096;
+
+TelemetryRing::TelemetryRing(size_t capacity):
+  mask(0), head(0), cachedTail(0), dropped(0), tail(0)
+{
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+  buffer.resize(size);
+  mask = size - 1;
+}
+
+size_t TelemetryRing::pop(TelemetrySample* out, size_t max)
+{
+  uint64_t t = tail.load(std::memory_order_relaxed);
+  uint64_t h = head.load(std::memory_order_acquire);
+  size_t n = (size_t)std::min<uint64_t>(h - t, max);
+  for (size_t i = 0; i < n; i++)
+  {
+    out[i] = buffer[(t + i) & mask];
+  }
+  tail.store(t + n, std::memory_order_release);
+  return n;
+}
+
+TelemetryWriter::TelemetryWriter():
+  ring(0), profile(0), lastTick(0), nextTrain(0), running(false), fd(-1), rate(0.0), window(0), windowOffset(0), windowUsed(0),
+  count(0), droppedTotal(0), writerSeconds(0.0), failed(false)
+{
+}
+
+bool TelemetryWriter::open(const std::string& path, double simRate, const std::vector<vec3>& points,
+                           const VelocityProfile& velocityProfile, const FrameTable& frameTable,
+                           size_t ringCapacity)
+{
+  close();
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+
+  rate = simRate;
+  count = 0;
+  droppedTotal = 0;
+  failed = false;
+  if (!mapWindow(0))
+  {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  windowUsed = TELEMETRY_HEADER_SIZE;
+
+  profile = &velocityProfile;
+  nextTrain = 0;
+  index = frameTable.arcLengths();
+  computeForceProfile(points, velocityProfile, frameTable, &forces);
+
+  ring = new TelemetryRing(ringCapacity);
+  running.store(true);
+  worker = std::thread(&TelemetryWriter::drain, this);
+  return true;
+}
+
+bool TelemetryWriter::mapWindow(uint64_t offset)
+{
+  if (window)
+    munmap(window, TELEMETRY_WINDOW);
+  window = 0;
+
+  if (ftruncate(fd, offset + TELEMETRY_WINDOW) != 0)
+    return false;
+  void* p = mmap(0, TELEMETRY_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+  if (p == MAP_FAILED)
+    return false;
+
+  window = (char*)p;
+  windowOffset = offset;
+  windowUsed = 0;
+  return true;
+}
+
+bool TelemetryWriter::write(const TelemetryRecord* records, size_t n)
+{
+  while (n > 0)
+  {
+    if (windowUsed == TELEMETRY_WINDOW && !mapWindow(windowOffset + TELEMETRY_WINDOW))
+      return false;
+
+    size_t fit = std::min<uint64_t>(n, (TELEMETRY_WINDOW - windowUsed) / sizeof(TelemetryRecord));
+    memcpy(window + windowUsed, records, fit * sizeof(TelemetryRecord));
+    windowUsed += fit * sizeof(TelemetryRecord);
+    count += fit;
+    records += fit;
+    n -= fit;
+  }
+  return true;
+}
+
+void TelemetryWriter::drain()
+{
+  std::vector<TelemetrySample> samples(TELEMETRY_BATCH);
+  std::vector<TelemetryRecord> batch(TELEMETRY_BATCH);
+  for (;;)
+  {
+    //Everything pushed before close is in the ring once running reads false
+    bool stopping = !running.load(std::memory_order_acquire);
+    size_t n = ring->pop(&samples[0], samples.size());
+    if (n > 0)
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        annotate(samples[i], &batch[i]);
+      }
+      if (!failed && !write(&batch[0], n))
+        failed = true;
+      continue;
+    }
+    if (stopping)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  writerSeconds = ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+bool TelemetryWriter::close()
+{
+  if (fd < 0)
+    return true;
+
+  running.store(false, std::memory_order_release);
+  worker.join();
+  droppedTotal = ring->droppedCount();
+  delete ring;
+  ring = 0;
+
+  if (window)
+    munmap(window, TELEMETRY_WINDOW);
+  window = 0;
+
+  uint32_t header[4] = { TELEMETRY_FILE_MAGIC, TELEMETRY_FILE_VERSION,
+                         (uint32_t)sizeof(TelemetryRecord), 0 };
+  char bytes[TELEMETRY_HEADER_SIZE] = {};
+  memcpy(bytes, header, sizeof(header));
+  memcpy(bytes + 16, &count, sizeof(count));
+  memcpy(bytes + 24, &rate, sizeof(rate));
+
+  bool ok = !failed;
+  ok = (pwrite(fd, bytes, sizeof(bytes), 0) == (ssize_t)sizeof(bytes)) && ok;
+  ok = (ftruncate(fd, TELEMETRY_HEADER_SIZE + count * sizeof(TelemetryRecord)) == 0) && ok;
+  ok = (::close(fd) == 0) && ok;
+  fd = -1;
+  return ok;
+}
+
+void TelemetryWriter::annotate(const TelemetrySample& sample, TelemetryRecord* record)
+{
+  //Ticks arrive whole, so a train's index is its place in its tick
+  if (sample.tick != lastTick)
+    nextTrain = 0;
+  lastTick = sample.tick;
+
+  float s = sample.arcLength;
+  float t;
+  int k = index.sampleAt(s, &t);
+  const ForceSample& a = forces[k];
+  const ForceSample& b = forces[(k + 1) % forces.size()];
+
+  record->tick = sample.tick;
+  record->train = nextTrain++;
+  record->stage = profile->stageAt(s);
+  record->segment = profile->segmentAt(s).type;
+  record->laps = (uint32_t)(sample.travelled / profile->trackLength());
+  record->arcLength = s;
+  record->velocity = profile->velocityAt(s);
+  record->g[0] = mix(a.gLateral, b.gLateral, t);
+  record->g[1] = mix(a.gVertical, b.gVertical, t);
+  record->g[2] = mix(a.gLongitudinal, b.gLongitudinal, t);
+}
@@ -0,0 +1,152 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "forceprofile.h"
+#include "frametable.h"
+#include "train.h"
+
+//One train at one simulation step, 32 bytes
+struct TelemetryRecord {
+  uint32_t tick;
+  uint16_t train;       //index, wraps past 65535 trains
+  uint8_t stage;        //RideStage
+  uint8_t segment;      //SegmentType
+  uint32_t laps;
+  float arcLength;
+  float velocity;
+  float g[3];           //lateral, vertical, longitudinal, see ForceSample
+};
+
+//What the simulation thread hands over for one train, 16 bytes. The
+//writer works out the rest from the track.
+struct TelemetrySample {
+  double travelled;     //see Train::distance
+  float arcLength;
+  uint32_t tick;
+};
+
+//Fixed size queue between one producer and one consumer thread. Neither
+//side ever locks or waits: a push that doesn't fit is dropped and
+//counted, so the simulation is never held up by the disk.
+class TelemetryRing {
+public:
+  //capacity is rounded up to a power of two
+  explicit TelemetryRing(size_t capacity);
+
+  //Producer side only: false, counting them as dropped, unless n more
+  //samples fit. Fill them with slot and publish them with commit.
+  bool reserve(size_t n)
+  {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h + n - cachedTail > buffer.size())
+    {
+      cachedTail = tail.load(std::memory_order_acquire);
+      if (h + n - cachedTail > buffer.size())
+      {
+        dropped.store(dropped.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    return true;
+  }
+  TelemetrySample& slot(size_t i) { return buffer[(head.load(std::memory_order_relaxed) + i) & mask]; }
+  void commit(size_t n) { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+  //Consumer side only. Copies up to max samples into out and returns how many.
+  size_t pop(TelemetrySample* out, size_t max);
+
+  uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  std::vector<TelemetrySample> buffer;
+  size_t mask;
+
+  //Padding keeps each side's counters off the other's cache line
+  char padding0[64];
+  std::atomic<uint64_t> head;
+  uint64_t cachedTail;        //producer's last look at tail
+  std::atomic<uint64_t> dropped;
+  char padding1[64];
+  std::atomic<uint64_t> tail;
+};
+
+//Streams telemetry to a binary file: a 32 byte header (magic, version,
+//record size, record count, simulation rate) and then the records. The
+//simulation thread only copies each train's position and distance into
+//a TelemetryRing, a tick at a time. A background thread numbers the
+//trains, counts their laps, looks up the speed, stage, segment and forces
+//and drains the records into a memory mapped window of the file.
+class TelemetryWriter {
+public:
+  TelemetryWriter();
+  ~TelemetryWriter() { close(); }
+
+  //The trains run on the track made of points, profile and frames. The
+  //profile has to outlive the writer, frames is only needed here. Returns
+  //false if the file can't be created.
+  bool open(const std::string& path, double simRate, const std::vector<vec3>& points,
+            const VelocityProfile& profile, const FrameTable& frames, size_t ringCapacity = 1 << 17);
+  bool isOpen() const { return fd >= 0; }
+
+  //Called from the simulation thread only, once a tick with every train
+  //in index order. A tick that doesn't fit in the ring is dropped whole.
+  bool push(uint32_t tick, const Train* trains, int numTrains)
+  {
+    if (!ring->reserve(numTrains))
+      return false;
+    for (int t = 0; t < numTrains; t++)
+    {
+      TelemetrySample& sample = ring->slot(t);
+      sample.travelled = trains[t].distance();
+      sample.arcLength = trains[t].arcLength();
+      sample.tick = tick;
+    }
+    ring->commit(numTrains);
+    return true;
+  }
+
+  //Drains what is left, writes the header and closes the file. Returns
+  //false if anything failed.
+  bool close();
+
+  uint64_t written() const { return count; }
+  //CPU time the writer thread has used, valid after close
+  double writerCpuSeconds() const { return writerSeconds; }
+  uint64_t dropped() const { return ring ? ring->droppedCount() : droppedTotal; }
+
+private:
+  TelemetryWriter(const TelemetryWriter&);
+  TelemetryWriter& operator=(const TelemetryWriter&);
+
+  void drain();
+  void annotate(const TelemetrySample& sample, TelemetryRecord* record);
+  bool write(const TelemetryRecord* records, size_t n);
+  bool mapWindow(uint64_t offset);
+
+  TelemetryRing* ring;
+  const VelocityProfile* profile;
+  ArcLengthIndex index;     //of the force samples
+  std::vector<ForceSample> forces;
+  uint32_t lastTick;        //of the last sample annotated
+  int nextTrain;            //index the next sample of lastTick is for
+  std::thread worker;
+  std::atomic<bool> running;
+
+  int fd;
+  double rate;
+  char* window;             //mapped part of the file
+  uint64_t windowOffset;    //file offset of window
+  uint64_t windowUsed;
+  uint64_t count;
+  uint64_t droppedTotal;      //kept once the ring is gone
+  double writerSeconds;
+  bool failed;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include "track.h"
+
+#include <fstream>
+#include <iostream>
+#include <cmath>
+
+#include "Vec3f.h"
+#include "Vec3f_FileIO.h"
+
+using namespace std;
+
+vec3 arcLengthParameterization(vec3 bead_pos, int& i, const vector<vec3>& points, double deltaS)
+{
+
+  vec3 newBeadPos;
+  int size = points.size();
+  //assume points is at least i + 1 in size
+
+  //case 1, the distance between the next point is greater than deltaS
+  if (abs(length((points.at((i +1) % size) - bead_pos))) > deltaS)
+  {
+    newBeadPos = bead_pos + (points.at((i + 1) % size) - bead_pos) * (float)((deltaS / abs((length(points.at((i + 1)%size) - bead_pos)))));
+    return newBeadPos;
+  } else
+  {
+    //The distance between the bead postion and the next point is less than or
+    //equal to deltaS, so the bead moves past it. s_prime is the distance
+    //covered up to the last point passed.
+
+    double s_prime = abs(length((points.at((i + 1) % size) - bead_pos)));
+    i +=1;
+
+    while (( s_prime + abs(length(points.at((i + 1) % size) - points.at(i % size) ))  ) < deltaS)
+    {
+      s_prime = s_prime + abs((length(points.at((i + 1) % size)  - points.at(i % size))));
+      i += 1;
+    }
+
+    vec3 segment = points.at((i + 1)%size) - points.at(i % size);
+    double segmentLength = length(segment);
+    if (segmentLength <= 0.0)
+    {
+      return points.at(i % size);
+    }
+
+    newBeadPos = points.at(i % size) + segment * (float)(abs((deltaS - s_prime))/segmentLength);
+
+    return newBeadPos;
+  }
+}
+
+int highestPoint(const std::vector<vec3>& points)
+{
+  //assume points is at least one element
+
+  int index = 0;
+  vec3 highestPoint = points.at(0);
+
+  for (int i = 0; i < points.size(); i++)
+  {
+    if ( points.at(i).y > highestPoint.y)
+    {
+      index = i;
+      highestPoint = points.at(i);
+    }
+  }
+
+  return index;
+}
+
+
+void generateSecondLineForTrack(const vector<vec3>& current_Points,
+                                vector<vec3>* newPoints1,
+                                std::vector<vec3>* newPoints2,
+                                vector<vec3>* normals)
+{
+    for (int i = 0; i < current_Points.size(); i++)
+    {
+      vec3 posFuture = current_Points.at( (i + 1)%current_Points.size());
+      vec3 posPast = current_Points.at( (i - 1)%current_Points.size());
+      vec3 posCurrent = current_Points.at(i);
+
+      double x = calculate_x(posPast, posCurrent, posFuture);
+      double c = calculate_c(posPast, posFuture);
+
+      vec3 acc_perpendicular = (float)(1.0f/(pow(x,2) + pow(c,2)))
+                          * (posFuture - 2.0f * posCurrent + posPast);
+      vec3 normal = acc_perpendicular + GRAVITY;
+
+      vec3 Tangent = posFuture - posCurrent;
+      vec3 normalized_Tangent = normalize(Tangent);
+
+      vec3 normalized_normal = normalize(normal);
+
+      vec3 B = cross(normalized_Tangent, normalized_normal);
+      vec3 B_hat = normalize(B);
+
+      vec3 newPoint1 = posCurrent + 0.3f * B_hat;
+      vec3 newPoint2 = posCurrent - 0.3f * B_hat;
+      newPoints1->push_back(newPoint1);
+      newPoints2->push_back(newPoint2);
+    }
+    //newPoints1->push_back(newPoints->at(0));
+
+    for (int j = 0; j < newPoints1->size(); j++)
+    {
+      normals->push_back(vec3(0,1,0));
+    }
+}
+
+//Reads the control points of a .con file, scaled into world coordinates
+void loadControlPoints(vector<vec3>* points, const std::string& file, bool verbose)
+{
+    VectorContainerVec3f vectors;
+
+    if (verbose)
+      std::cout<< "Now reading from file named" << file << "\n";
+    loadVec3fFromFile(vectors, file);
+
+    for (int i = 0; i < vectors.size(); i++)
+    {
+      Vec3f vec = vectors.at(i);
+      if (verbose)
+        std::cout << vec << std::endl;
+      points->push_back(vec3(5 * vec.m_x, 5 * vec.m_z, 5 * vec.m_y));
+    }
+}
+
+bool saveControlPoints(const vector<vec3>& points, const std::string& file,
+                       const vector<std::string>& extraLines)
+{
+    std::ofstream output(file.c_str());
+    if (!output)
+      return false;
+
+    //Same header as the hand made tracks, and the inverse of the scaling
+    //and axis swap in loadControlPoints
+    output << "cver 1 1\nname: noname\npoints: " << points.size() << " " << points.size()
+           << "\ntype: closed\n";
+    output.precision(6);
+    output << std::fixed;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      vec3 p = points[i] / 5.f;
+      output << p.x << " " << p.z << " " << p.y << " 1\n";
+    }
+    for (size_t i = 0; i < extraLines.size(); i++)
+    {
+      output << extraLines[i] << "\n";
+    }
+    return (bool)output;
+}
+
+//Smooths the closed control polygon in points by repeatedly adding the
+//midpoints and then averaging neighbours
+void subdivideCurve(vector<vec3>* points, int subdivisions)
+{
+    if (points->size() < 2)
+      return;
+
+    int j;
+    for (int i = 0; i < subdivisions; i++)
+    {
+      vector<vec3> Q;
+      //Add the mid points of the control points to the set Q
+      for ( j = 0; j < (points->size() - 1); j++)
+      {
+        Q.push_back(points->at(j));
+        Q.push_back((points->at(j) + points->at(j + 1)) * 0.5f);
+      }
+      //Makes sure the curve connects back to the start
+      Q.push_back(points->at(j));
+      //Q.push_back(points)
+
+      //Clear the points since we will want to make a new
+      //set of points
+      points->clear();
+      int r;
+      //Subdivide the curve so that the new set of points will be smoother
+      for (r = 0; r < (Q.size() - 1); r++)
+      {
+        points->push_back((Q.at(r) + Q.at(r +1)) * 0.5f);
+      }
+      //Add in the first point so that the curve will go back to the start
+      points->push_back(points->at(0));
+    }
+}
+
+//This function will make a curve that will be used to make the coaster
+void generateCurve(vector<vec3>* points, vector<vec3>* normals, const std::string& file)
+{
+    loadControlPoints(points, file, true);
+    subdivideCurve(points, CURVE_SUBDIVISIONS);
+
+    //Normals is poorly named here should actually be color
+    for (int i = 0; i < points->size(); i++)
+    {
+      normals->push_back(vec3(0.f, 0.f,1.f));
+    }
+}
+
+//This calculation is used to calculate the x value
+//The x value is an important part to calculating the
+//radius of the curvature circle of the curve
+double calculate_x(vec3 pos_prev, vec3 pos_current,vec3 pos_next)
+{
+
+  double x = 1.0f/2.0f * ( length(pos_next - 2.0f * pos_current + pos_prev));
+  return x;
+}
+
+//C is defined as the half distance between the past point and the future point
+double calculate_c(vec3 pos_past, vec3 pos_future)
+{
+  double c = 1.0f/2.0f * length(pos_future - pos_past);
+  return c;
+}
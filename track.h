@@ -0,0 +1,47 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include "glm/glm.hpp"
+#include <string>
+#include <vector>
+
+using namespace glm;
+
+const vec3 GRAVITY = vec3(0, 9.81, 0);
+
+//kg/m^3, for drag
+const double AIR_DENSITY = 1.225;
+
+//Times generateCurve subdivides the control points
+const int CURVE_SUBDIVISIONS = 5;
+
+//Reads the control points from a .con file and subdivides them into the
+//dense closed curve the ride runs on
+void generateCurve(std::vector<vec3>* points, std::vector<vec3>* normals,
+                   const std::string& file = "./Track3.con");
+
+//The two halves of generateCurve, for tools that load many tracks quietly.
+//loadControlPoints throws std::runtime_error if the file can't be opened.
+void loadControlPoints(std::vector<vec3>* points, const std::string& file, bool verbose);
+void subdivideCurve(std::vector<vec3>* points, int subdivisions);
+
+//Writes control points as a .con file that loadControlPoints reads back,
+//followed by extraLines. Returns false if the file can't be written.
+bool saveControlPoints(const std::vector<vec3>& points, const std::string& file,
+                       const std::vector<std::string>& extraLines);
+
+//The two rails either side of the curve
+void generateSecondLineForTrack(const std::vector<vec3>& current_Points,
+                                std::vector<vec3>* newPoints1,
+                                std::vector<vec3>* newPoints2,
+                                std::vector<vec3>* normals);
+
+int highestPoint(const std::vector<vec3>& points);
+
+//Moves bead_pos deltaS along the curve, updating i to the last point passed
+vec3 arcLengthParameterization(vec3 bead_pos, int& i, const std::vector<vec3>& points, double deltaS);
+
+double calculate_x(vec3 pos_prev, vec3 pos_current, vec3 pos_next);
+double calculate_c(vec3 pos_past, vec3 pos_future);
+
+#endif
@@ -0,0 +1,232 @@
+#include "trackquery.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+//Keep the grid from blowing up on very long, thin tracks
+const int MAX_CELLS_PER_AXIS = 256;
+
+TrackQuery::TrackQuery(const std::vector<vec3>& curve_points, float cell):
+  points(curve_points), totalLength(0.f), origin(0.f), cellSize(cell)
+{
+  int size = points.size();
+
+  //Segment i goes from points[i] to points[(i + 1) % size], so the
+  //track is treated as closed like everywhere else
+  vec3 lo = points.at(0);
+  vec3 hi = points.at(0);
+  arcLength.reserve(size);
+  for (int i = 0; i < size; i++)
+  {
+    arcLength.push_back(totalLength);
+    totalLength += length(points.at((i + 1) % size) - points.at(i));
+    lo = min(lo, points.at(i));
+    hi = max(hi, points.at(i));
+  }
+
+  if (cellSize <= 0.f)
+  {
+    //Aim for roughly one segment per cell, but never let a segment
+    //span more than a couple of cells
+    vec3 extent = max(hi - lo, vec3(1e-3f));
+    float volumeCell = std::cbrt(extent.x * extent.y * extent.z / size);
+    cellSize = std::max(volumeCell, 2.f * totalLength / size);
+  }
+
+  for (int a = 0; a < 3; a++)
+  {
+    dims[a] = (int)((hi[a] - lo[a]) / cellSize) + 1;
+    if (dims[a] > MAX_CELLS_PER_AXIS)
+    {
+      dims[a] = MAX_CELLS_PER_AXIS;
+    }
+  }
+  cellSize = std::max(cellSize, std::max((hi.x - lo.x) / dims[0],
+                                std::max((hi.y - lo.y) / dims[1], (hi.z - lo.z) / dims[2])));
+  origin = lo;
+
+  //Two passes over the segment bounding boxes: count, then fill
+  int numCells = dims[0] * dims[1] * dims[2];
+  cellStart.assign(numCells + 1, 0);
+  for (int pass = 0; pass < 2; pass++)
+  {
+    std::vector<int> fill;
+    if (pass == 1)
+    {
+      for (int c = 0; c < numCells; c++)
+      {
+        cellStart[c + 1] += cellStart[c];
+      }
+      cellSegments.resize(cellStart[numCells]);
+      fill.assign(cellStart.begin(), cellStart.end() - 1);
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+      int x0, y0, z0, x1, y1, z1;
+      vec3 a = points.at(i);
+      vec3 b = points.at((i + 1) % size);
+      cellOf(min(a, b), &x0, &y0, &z0);
+      cellOf(max(a, b), &x1, &y1, &z1);
+
+      for (int z = z0; z <= z1; z++)
+        for (int y = y0; y <= y1; y++)
+          for (int x = x0; x <= x1; x++)
+          {
+            int c = (z * dims[1] + y) * dims[0] + x;
+            if (pass == 0)
+              cellStart[c + 1]++;
+            else
+              cellSegments[fill[c]++] = i;
+          }
+    }
+  }
+}
+
+void TrackQuery::cellOf(vec3 p, int* cx, int* cy, int* cz) const
+{
+  vec3 c = (p - origin) / cellSize;
+  *cx = std::min(std::max((int)floor(c.x), 0), dims[0] - 1);
+  *cy = std::min(std::max((int)floor(c.y), 0), dims[1] - 1);
+  *cz = std::min(std::max((int)floor(c.z), 0), dims[2] - 1);
+}
+
+void TrackQuery::testCell(int cx, int cy, int cz, vec3 p, TrackHit* best) const
+{
+  int size = points.size();
+  int c = (cz * dims[1] + cy) * dims[0] + cx;
+
+  for (int k = cellStart[c]; k < cellStart[c + 1]; k++)
+  {
+    int i = cellSegments[k];
+    vec3 a = points[i];
+    vec3 ab = points[(i + 1) % size] - a;
+
+    float len2 = dot(ab, ab);
+    float t = (len2 > 0.f) ? clamp(dot(p - a, ab) / len2, 0.f, 1.f) : 0.f;
+    float d = length(p - (a + t * ab));
+
+    if (d < best->distance)
+    {
+      best->distance = d;
+      best->segment = i;
+      best->s = arcLength[i] + t * sqrt(len2);
+    }
+  }
+}
+
+float TrackQuery::clearance(float apart) const
+{
+  int size = points.size();
+  float closest2 = INFINITY;
+  for (int i = 0; i < size; i++)
+  {
+    //Only as far out as the closest approach so far, or the whole grid
+    vec3 p = points[i];
+    int x0 = 0, y0 = 0, z0 = 0, x1 = dims[0] - 1, y1 = dims[1] - 1, z1 = dims[2] - 1;
+    if (closest2 < INFINITY)
+    {
+      float reach = sqrt(closest2);
+      cellOf(p - vec3(reach), &x0, &y0, &z0);
+      cellOf(p + vec3(reach), &x1, &y1, &z1);
+    }
+
+    for (int z = z0; z <= z1; z++)
+      for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+        {
+          int c = (z * dims[1] + y) * dims[0] + x;
+          for (int k = cellStart[c]; k < cellStart[c + 1]; k++)
+          {
+            //Each pair once, from the point with the lower index, and
+            //only if they are far enough apart along the track
+            int j = cellSegments[k];
+            float along = arcLength[j] - arcLength[i];
+            if (j <= i || along < apart || totalLength - along < apart)
+              continue;
+            vec3 d = points[j] - p;
+            closest2 = std::min(closest2, dot(d, d));
+          }
+        }
+  }
+  return sqrt(closest2);
+}
+
+TrackHit TrackQuery::nearest(vec3 p) const
+{
+  TrackHit best;
+  best.s = 0.f;
+  best.segment = -1;
+  best.distance = std::numeric_limits<float>::max();
+
+  int cx, cy, cz;
+  cellOf(p, &cx, &cy, &cz);
+
+  //Search rings of cells around the query cell. Anything outside ring r - 1
+  //is at least r - 1 cells away (clamping p into the grid only brings it
+  //closer), so once the best hit is nearer than that we are done.
+  int maxRing = std::max(dims[0], std::max(dims[1], dims[2]));
+  for (int r = 0; r <= maxRing; r++)
+  {
+    if (best.distance <= (r - 1) * cellSize)
+    {
+      break;
+    }
+
+    for (int z = cz - r; z <= cz + r; z++)
+    {
+      if (z < 0 || z >= dims[2])
+        continue;
+      for (int y = cy - r; y <= cy + r; y++)
+      {
+        if (y < 0 || y >= dims[1])
+          continue;
+        for (int x = cx - r; x <= cx + r; x++)
+        {
+          if (x < 0 || x >= dims[0])
+            continue;
+          //only the shell of the ring, the inside was already tested
+          if (abs(x - cx) != r && abs(y - cy) != r && abs(z - cz) != r)
+            continue;
+          testCell(x, y, z, p, &best);
+        }
+      }
+    }
+  }
+
+  return best;
+}
+
+void TrackQuery::nearestBatch(const std::vector<vec3>& queries, std::vector<TrackHit>* hits,
+                              int numThreads) const
+{
+  hits->resize(queries.size());
+
+  if (numThreads <= 0)
+  {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  int count = queries.size();
+  numThreads = std::max(1, std::min(numThreads, count / 256));
+
+  int chunk = (count + numThreads - 1) / numThreads;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numThreads; t++)
+  {
+    int begin = t * chunk;
+    int end = std::min(count, begin + chunk);
+    workers.push_back(std::thread([this, &queries, hits, begin, end]() {
+      for (int q = begin; q < end; q++)
+      {
+        (*hits)[q] = nearest(queries[q]);
+      }
+    }));
+  }
+
+  for (size_t t = 0; t < workers.size(); t++)
+  {
+    workers[t].join();
+  }
+}
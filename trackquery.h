@@ -0,0 +1,52 @@
+#ifndef TRACKQUERY_H
+#define TRACKQUERY_H
+
+#include "glm/glm.hpp"
+#include <vector>
+
+using namespace glm;
+
+//Result of a closest point query against the track
+struct TrackHit {
+  float s;          //arc length of the closest point, measured from points[0]
+  int segment;      //the closest point lies between points[segment] and points[segment + 1]
+  float distance;   //distance from the query point to the track
+};
+
+//Uniform grid over the dense track segments, used to answer
+//"where on the track is this point" without scanning every segment
+class TrackQuery {
+public:
+  //points is the closed curve produced by generateCurve
+  //a cellSize of 0 picks one based on the track size
+  TrackQuery(const std::vector<vec3>& points, float cellSize = 0.f);
+
+  TrackHit nearest(vec3 p) const;
+
+  //Closest approach of two points of the track that are at least apart
+  //from each other along it, INFINITY if no two are
+  float clearance(float apart) const;
+
+  //Answers every query, splitting the work over numThreads threads
+  //(0 uses one thread per core)
+  void nearestBatch(const std::vector<vec3>& queries, std::vector<TrackHit>* hits,
+                    int numThreads = 0) const;
+
+  float trackLength() const { return totalLength; }
+
+private:
+  void cellOf(vec3 p, int* cx, int* cy, int* cz) const;
+  void testCell(int cx, int cy, int cz, vec3 p, TrackHit* best) const;
+
+  std::vector<vec3> points;
+  std::vector<float> arcLength;   //arc length at the start of each segment
+  float totalLength;
+
+  vec3 origin;
+  float cellSize;
+  int dims[3];
+  std::vector<int> cellStart;     //segments of cell c are cellSegments[cellStart[c] .. cellStart[c + 1])
+  std::vector<int> cellSegments;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "tracksegments.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "arclengthindex.h"
+#include "track.h"
+
+//Default speeds, in m/s
+const float STATION_SPEED = 1.f;
+const float LIFT_SPEED = 2.f;
+const float LAUNCH_SPEED = 8.f;
+
+//Share of the track given to the station and the brakes when the
+//segments are worked out from the shape
+const float STATION_FRACTION = 0.08f;
+const float BRAKE_FRACTION = 0.12f;
+
+//Height a point has to be below the next one to count as part of the lift
+const float CLIMB_TOLERANCE = 1e-4f;
+
+static const char* SEGMENT_NAMES[SEGMENT_TYPE_COUNT] = { "station", "lift", "free", "brake", "launch" };
+
+const char* segmentTypeName(SegmentType type)
+{
+  return (type >= 0 && type < SEGMENT_TYPE_COUNT) ? SEGMENT_NAMES[type] : "unknown";
+}
+
+static float defaultSpeed(SegmentType type)
+{
+  switch (type)
+  {
+  case SEGMENT_STATION:
+  case SEGMENT_BRAKE:
+    return STATION_SPEED;
+  case SEGMENT_LIFT:
+    return LIFT_SPEED;
+  case SEGMENT_LAUNCH:
+    return LAUNCH_SPEED;
+  default:
+    return 0.f;
+  }
+}
+
+std::vector<SegmentSpec> readSegmentSpecs(const std::string& file)
+{
+  std::ifstream input(file.c_str());
+  if (!input)
+  {
+    throw std::runtime_error("Unable to open file.");
+  }
+
+  std::vector<SegmentSpec> specs;
+  std::string line;
+  int lineNum = 0;
+  while (getline(input, line))
+  {
+    lineNum++;
+    line = line.substr(0, line.find('#'));
+    size_t first = line.find_first_not_of(" \t");
+    if (first == std::string::npos || line.compare(first, 8, "segment:") != 0)
+      continue;
+
+    std::istringstream ss(line.substr(first + 8));
+    std::string name;
+    SegmentSpec spec;
+    ss >> name >> spec.from >> spec.to;
+    if (!ss || spec.from < 0.f || spec.from > 1.f || spec.to < 0.f || spec.to > 1.f)
+    {
+      throw std::runtime_error("Bad segment line " + std::to_string(lineNum) + ": " + line);
+    }
+    if (!(ss >> spec.speed))
+      spec.speed = -1.f;
+
+    int t = 0;
+    while (t < SEGMENT_TYPE_COUNT && name != SEGMENT_NAMES[t])
+      t++;
+    if (t == SEGMENT_TYPE_COUNT)
+    {
+      throw std::runtime_error("Unknown segment type " + name + " on line " + std::to_string(lineNum));
+    }
+    spec.type = (SegmentType)t;
+    specs.push_back(spec);
+  }
+  return specs;
+}
+
+std::string segmentSpecLine(const SegmentSpec& spec)
+{
+  std::ostringstream line;
+  line << "segment: " << segmentTypeName(spec.type) << " " << spec.from << " " << spec.to;
+  if (spec.speed >= 0.f)
+    line << " " << spec.speed;
+  return line.str();
+}
+
+TrackSegments::TrackSegments(const std::vector<vec3>& points, int top):
+  startPoint(0)
+{
+  int size = points.size();
+  ArcLengthIndex index(points);
+  float L = index.trackLength();
+
+  //Walk back down the climb to the crest, then back over the station and
+  //the brakes
+  int k = top;
+  for (int n = 0; n < size / 2; n++)
+  {
+    int prev = (k + size - 1) % size;
+    if (points[prev].y >= points[k].y - CLIMB_TOLERANCE)
+      break;
+    k = prev;
+  }
+  int liftStart = k;
+
+  std::vector<int> label(size, 0);
+  std::vector<SegmentType> types;
+  types.push_back(SEGMENT_FREE_RUN);
+  types.push_back(SEGMENT_BRAKE);
+  types.push_back(SEGMENT_STATION);
+  types.push_back(SEGMENT_LIFT);
+
+  for (int n = 0; n < size && k != top; n++, k = (k + 1) % size)
+  {
+    label[k] = 3;
+  }
+
+  //Station, then brakes, measured back from the start of the lift
+  float back = 0.f;
+  k = liftStart;
+  for (int n = 0; n < size; n++)
+  {
+    int prev = (k + size - 1) % size;
+    back += length(points[k] - points[prev]);
+    k = prev;
+    if (label[k] != 0 || back > (STATION_FRACTION + BRAKE_FRACTION) * L)
+      break;
+    label[k] = (back <= STATION_FRACTION * L) ? 2 : 1;
+  }
+
+  std::vector<float> speeds;
+  for (size_t t = 0; t < types.size(); t++)
+  {
+    speeds.push_back(defaultSpeed(types[t]));
+  }
+  build(points, label, types, speeds);
+}
+
+TrackSegments::TrackSegments(const std::vector<vec3>& points, const std::vector<SegmentSpec>& specs):
+  startPoint(0)
+{
+  int size = points.size();
+  ArcLengthIndex index(points);
+  float L = index.trackLength();
+
+  //Label 0 is the free run filling the gaps, spec i is label i + 1
+  std::vector<SegmentType> types(1, SEGMENT_FREE_RUN);
+  std::vector<float> speeds(1, 0.f);
+  std::vector<int> label(size, 0);
+  for (size_t i = 0; i < specs.size(); i++)
+  {
+    types.push_back(specs[i].type);
+    speeds.push_back(specs[i].speed >= 0.f ? specs[i].speed : defaultSpeed(specs[i].type));
+
+    float from = specs[i].from * L;
+    float to = specs[i].to * L;
+    for (int k = 0; k < size; k++)
+    {
+      float s = index.sampleArcLength(k);
+      bool inside = (from <= to) ? (s >= from && s < to) : (s >= from || s < to);
+      if (inside)
+        label[k] = i + 1;
+    }
+  }
+
+  build(points, label, types, speeds);
+}
+
+void TrackSegments::build(const std::vector<vec3>& points, const std::vector<int>& label,
+                          const std::vector<SegmentType>& types, const std::vector<float>& speeds)
+{
+  int size = points.size();
+  ArcLengthIndex index(points);
+  float L = index.trackLength();
+  segments.clear();
+  pointSegment.assign(size, 0);
+
+  //Start at a change of label so no segment is split across point 0
+  int first = 0;
+  for (int k = 0; k < size; k++)
+  {
+    if (label[k] != label[(k + size - 1) % size])
+    {
+      first = k;
+      break;
+    }
+  }
+
+  for (int n = 0; n < size; )
+  {
+    int k = (first + n) % size;
+    TrackSegment segment;
+    segment.type = types[label[k]];
+    segment.speed = speeds[label[k]];
+    segment.first = k;
+
+    int run = 0;
+    while (n + run < size && label[(first + n + run) % size] == label[k])
+    {
+      pointSegment[(first + n + run) % size] = segments.size();
+      run++;
+    }
+    n += run;
+    segment.end = (k + run) % size;
+
+    float s0 = index.sampleArcLength(k);
+    float s1 = (run == size) ? s0 + L : index.sampleArcLength(segment.end);
+    segment.length = (s1 > s0) ? s1 - s0 : s1 - s0 + L;
+    segments.push_back(segment);
+  }
+
+  //The ride starts where the first free run after a lift begins, or at
+  //any free run if the track has no lift
+  startPoint = segments.empty() ? 0 : segments[0].first;
+  int count = segments.size();
+  bool found = false;
+  for (int i = 0; i < count; i++)
+  {
+    if (segments[i].type != SEGMENT_FREE_RUN || found)
+      continue;
+    const TrackSegment& before = segments[(i + count - 1) % count];
+    if (before.type == SEGMENT_LIFT || startPoint == segments[0].first)
+      startPoint = segments[i].first;
+    found = (before.type == SEGMENT_LIFT);
+  }
+}
+
+TrackSegments loadTrackSegments(const std::string& file, const std::vector<vec3>& points)
+{
+  std::vector<SegmentSpec> specs = readSegmentSpecs(file);
+  if (specs.empty())
+    return TrackSegments(points, highestPoint(points));
+  return TrackSegments(points, specs);
+}
@@ -0,0 +1,89 @@
+#ifndef TRACKSEGMENTS_H
+#define TRACKSEGMENTS_H
+
+#include "glm/glm.hpp"
+#include <string>
+#include <vector>
+
+using namespace glm;
+
+//What a stretch of track does to the train
+enum SegmentType {
+  SEGMENT_STATION = 0,    //loading, constant slow speed
+  SEGMENT_LIFT,           //chain lift, constant speed up to the crest
+  SEGMENT_FREE_RUN,       //no power, gravity only
+  SEGMENT_BRAKE,          //slows the train down to the next segment
+  SEGMENT_LAUNCH,         //accelerates the train to a set speed
+  SEGMENT_TYPE_COUNT
+};
+
+//Name used in .con files and reports
+const char* segmentTypeName(SegmentType type);
+
+//A run of curve points of one type. Points first .. end - 1 belong to it,
+//wrapping past the last point back to 0.
+struct TrackSegment {
+  SegmentType type;
+  int first;
+  int end;
+  float length;       //arc length covered
+  float speed;        //station and lift speed, brake and launch exit speed
+};
+
+//A "segment: type from to [speed]" line from a .con file. from and to are
+//fractions (0 to 1) of the track length from the first point, and wrap
+//when to is less than from. Leaving out speed uses the type's default.
+struct SegmentSpec {
+  SegmentType type;
+  float from;
+  float to;
+  float speed;        //negative for the default
+};
+
+//Reads the segment lines of a .con file. Throws std::runtime_error if the
+//file can't be opened or a segment line doesn't parse.
+std::vector<SegmentSpec> readSegmentSpecs(const std::string& file);
+
+//The line readSegmentSpecs reads back as spec
+std::string segmentSpecLine(const SegmentSpec& spec);
+
+//The track split into typed segments, with the segment of every curve
+//point stored so finding a cart's segment is a single lookup
+class TrackSegments {
+public:
+  TrackSegments(): startPoint(0) {}
+
+  //Works the segments out from the shape of the track: the lift is the
+  //climb up to points[top], the station and then the brakes come just
+  //before it, and everything else is free run
+  TrackSegments(const std::vector<vec3>& points, int top);
+
+  //Uses the segments read from a .con file, anything they leave out is
+  //free run
+  TrackSegments(const std::vector<vec3>& points, const std::vector<SegmentSpec>& specs);
+
+  int count() const { return segments.size(); }
+  const TrackSegment& segment(int i) const { return segments[i]; }
+
+  //Segment of curve point k
+  int segmentIndex(int k) const { return pointSegment[k]; }
+  const TrackSegment& at(int k) const { return segments[pointSegment[k]]; }
+
+  //Point the ride starts from: the start of the first free run after a
+  //lift, or of the first segment if there is no lift
+  int start() const { return startPoint; }
+
+private:
+  void build(const std::vector<vec3>& points, const std::vector<int>& label,
+             const std::vector<SegmentType>& types, const std::vector<float>& speeds);
+
+  std::vector<TrackSegment> segments;
+  std::vector<unsigned short> pointSegment;
+  int startPoint;
+};
+
+//The segments of a track file: its segment lines if it has any, otherwise
+//worked out from the shape with the highest point as the crest
+TrackSegments loadTrackSegments(const std::string& file, const std::vector<vec3>& points);
+
+#endif
@@ -0,0 +1,56 @@
+#include "train.h"
+
+#include <cmath>
+
+Train::Train(const VelocityProfile& velocityProfile, float start, int cars, float coupling):
+  profile(&velocityProfile)
+{
+  float L = profile->trackLength();
+  current.centre = start - floor(start / L) * L;
+  current.previousCentre = current.centre;
+  current.travelled = 0.0;
+  current.cars = cars;
+  current.coupling = coupling;
+}
+
+Train::Train(const VelocityProfile& velocityProfile, const TrainState& state):
+  profile(&velocityProfile), current(state)
+{
+}
+
+void Train::step(double dt)
+{
+  //With every car the same mass the centre of mass sits halfway along the
+  //train, so the energy model is looked up there
+  double vs = profile->velocityAt(current.centre) * dt;
+
+  current.travelled += vs;
+  current.previousCentre = current.centre;
+  current.centre += vs;
+
+  float L = profile->trackLength();
+  if (current.centre >= L)
+  {
+    current.centre -= L;
+  }
+}
+
+float Train::interpolatedArcLength(float alpha) const
+{
+  float s = current.centre;
+  //the last step may have wrapped past the end of the track
+  if (s < current.previousCentre)
+  {
+    s += profile->trackLength();
+  }
+  return current.previousCentre + (s - current.previousCentre) * alpha;
+}
+
+void Train::carArcLengths(float alpha, float* out) const
+{
+  float front = interpolatedArcLength(alpha) + 0.5f * (current.cars - 1) * current.coupling;
+  for (int c = 0; c < current.cars; c++)
+  {
+    out[c] = front - c * current.coupling;
+  }
+}
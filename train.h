@@ -0,0 +1,64 @@
+#ifndef TRAIN_H
+#define TRAIN_H
+
+#include <stdint.h>
+
+#include "velocityprofile.h"
+
+//Distance along the track between neighbouring cars, about one cart length
+const float CAR_COUPLING = 0.5f;
+
+//Everything a train carries from one step to the next, kept flat and
+//trivially copyable so many trains can be saved and restored as one block
+//of memory (see snapshot.h)
+struct TrainState {
+  float centre;           //arc length of the centre of mass
+  float previousCentre;   //the same before the last step
+  double travelled;       //total distance, for counting laps
+  int32_t cars;
+  float coupling;
+};
+
+//A train of cars coupled a fixed distance apart along the track. It moves
+//as one body at the speed the profile gives for its centre of mass, so a
+//step costs the same however many cars it has. Car positions are derived
+//from the centre only when they are asked for.
+class Train {
+public:
+  //centre is the arc length of the centre of mass, coupling the distance
+  //along the track between neighbouring cars
+  Train(const VelocityProfile& profile, float centre, int cars, float coupling);
+
+  //Carries on from a saved state
+  Train(const VelocityProfile& profile, const TrainState& state);
+
+  //Advances the train by one fixed simulation step of dt seconds
+  void step(double dt);
+
+  int cars() const { return current.cars; }
+  float coupling() const { return current.coupling; }
+
+  //Arc length of the centre of mass, in [0, track length)
+  float arcLength() const { return current.centre; }
+  float velocity() const { return profile->velocityAt(current.centre); }
+  RideStage stage() const { return profile->stageAt(current.centre); }
+  const TrackSegment& segment() const { return profile->segmentAt(current.centre); }
+  int laps() const { return (int)(current.travelled / profile->trackLength()); }
+  double distance() const { return current.travelled; }
+
+  const TrainState& state() const { return current; }
+
+  //Centre of mass part way (alpha in [0, 1]) between the last two steps
+  float interpolatedArcLength(float alpha) const;
+
+  //Arc length of every car, front car first, part way between the last
+  //two steps. out needs room for cars() values. The values aren't wrapped,
+  //FrameTable and computeCartFrames wrap them.
+  void carArcLengths(float alpha, float* out) const;
+
+private:
+  const VelocityProfile* profile;
+  TrainState current;
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "trainphysics.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "arclengthindex.h"
+#include "track.h"
+
+//Table rows per curve point
+const int PHYSICS_SAMPLES_PER_POINT = 4;
+
+//m/s^2, used when the ride parameters don't give a brake deceleration
+const float DEFAULT_BRAKE_DECELERATION = 4.f;
+const float LAUNCH_ACCELERATION = 10.f;
+
+TrainPhysics::TrainPhysics(const std::vector<vec3>& points, const TrackSegments& segments,
+                           const RideParameters& params):
+  totalLength(0.f), spacing(0.f), invSpacing(0.f), friction(params.friction), drag(0.f), count(0)
+{
+  int size = points.size();
+  ArcLengthIndex index(points);
+  totalLength = index.trackLength();
+  if (params.mass > 0.f)
+    drag = 0.5 * AIR_DENSITY * params.dragArea / params.mass;
+
+  //Tangent and curvature vector at every curve point, by central differences
+  std::vector<vec3> tangent(size), curvature(size);
+  for (int k = 0; k < size; k++)
+  {
+    vec3 d = points[(k + 1) % size] - points[(k + size - 1) % size];
+    tangent[k] = (length(d) > 0.f) ? normalize(d) : vec3(0, 0, 1);
+  }
+  for (int k = 0; k < size; k++)
+  {
+    int prev = (k + size - 1) % size;
+    int next = (k + 1) % size;
+    float ds = length(points[next] - points[k]) + length(points[k] - points[prev]);
+    curvature[k] = (ds > 0.f) ? (tangent[next] - tangent[prev]) / ds : vec3(0.f);
+  }
+
+  float brake = (params.brakeDeceleration > 0.f) ? params.brakeDeceleration : DEFAULT_BRAKE_DECELERATION;
+  int rows = size * PHYSICS_SAMPLES_PER_POINT;
+  spacing = totalLength / rows;
+  invSpacing = 1.f / spacing;
+  table.resize(rows + 1);
+
+  for (int j = 0; j < rows; j++)
+  {
+    float t;
+    int k = index.sampleAt(j * spacing, &t);
+    int next = (k + 1) % size;
+    vec3 T = normalize(mix(tangent[k], tangent[next], t));
+    vec3 K = mix(curvature[k], curvature[next], t);
+    vec3 across = GRAVITY - dot(GRAVITY, T) * T;
+
+    Sample& row = table[j];
+    row.slope = -dot(GRAVITY, T);
+    row.curvature2 = dot(K, K);
+    row.curvGravity = dot(K, GRAVITY);
+    row.gravity2 = dot(across, across);
+
+    const TrackSegment& seg = segments.at(k);
+    row.push = 0.f;
+    row.lo = -FLT_MAX;
+    row.hi = FLT_MAX;
+    row.hold = 0.f;
+    switch (seg.type)
+    {
+    case SEGMENT_STATION:
+    case SEGMENT_LIFT:
+      row.lo = row.hi = seg.speed;
+      row.hold = 1.f;
+      break;
+    case SEGMENT_BRAKE:
+      row.push = -brake;
+      row.lo = seg.speed;
+      break;
+    case SEGMENT_LAUNCH:
+      row.push = LAUNCH_ACCELERATION;
+      row.hi = seg.speed;
+      break;
+    default:
+      break;
+    }
+  }
+  table[rows] = table[0];
+}
+
+int TrainPhysics::addTrain(float s, float v)
+{
+  //The arrays grow a whole group of lanes at a time, the spare lanes just
+  //carry copies that are never reported
+  if (count % PHYSICS_LANES == 0)
+  {
+    position.resize(count + PHYSICS_LANES, 0.f);
+    speed.resize(count + PHYSICS_LANES, 0.f);
+    lapCount.resize(count + PHYSICS_LANES, 0);
+  }
+  position[count] = s - floor(s / totalLength) * totalLength;
+  speed[count] = v;
+  lapCount[count] = 0;
+  return count++;
+}
+
+#ifdef __SSE2__
+
+static inline __m128 clampAbs(__m128 x, __m128 limit)
+{
+  return _mm_min_ps(_mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+}
+
+void TrainPhysics::step(float dt)
+{
+  const __m128 vdt = _mm_set1_ps(dt);
+  const __m128 vlength = _mm_set1_ps(totalLength);
+  const __m128 vinv = _mm_set1_ps(invSpacing);
+  const __m128 vfriction = _mm_set1_ps(friction);
+  const __m128 vdrag = _mm_set1_ps(drag);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 two = _mm_set1_ps(2.f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 signBit = _mm_set1_ps(-0.f);
+  const float* rows = &table[0].slope;
+  const int last = table.size() - 1;
+
+  for (int i = 0; i < count; i += PHYSICS_LANES)
+  {
+    __m128 s = _mm_loadu_ps(&position[i]);
+    __m128 v = _mm_loadu_ps(&speed[i]);
+
+    //Nearest table row of each lane
+    int k[PHYSICS_LANES];
+    _mm_storeu_si128((__m128i*)k, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(s, vinv), half)));
+    for (int l = 0; l < PHYSICS_LANES; l++)
+    {
+      k[l] = std::min(std::max(k[l], 0), last) * 8;
+    }
+    __m128 slope = _mm_loadu_ps(rows + k[0]);
+    __m128 curv2 = _mm_loadu_ps(rows + k[1]);
+    __m128 curvG = _mm_loadu_ps(rows + k[2]);
+    __m128 grav2 = _mm_loadu_ps(rows + k[3]);
+    _MM_TRANSPOSE4_PS(slope, curv2, curvG, grav2);
+    __m128 push = _mm_loadu_ps(rows + k[0] + 4);
+    __m128 lo = _mm_loadu_ps(rows + k[1] + 4);
+    __m128 hi = _mm_loadu_ps(rows + k[2] + 4);
+    __m128 hold = _mm_loadu_ps(rows + k[3] + 4);
+    _MM_TRANSPOSE4_PS(push, lo, hi, hold);
+
+    //Normal force per unit mass, and the speed after gravity and drag
+    __m128 v2 = _mm_mul_ps(v, v);
+    __m128 n2 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(v2, v2), curv2),
+                           _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, v2), curvG), grav2));
+    __m128 normal = _mm_sqrt_ps(_mm_max_ps(n2, zero));
+    __m128 absV = _mm_andnot_ps(signBit, v);
+    __m128 accel = _mm_sub_ps(slope, _mm_mul_ps(vdrag, _mm_mul_ps(v, absV)));
+    __m128 vf = _mm_add_ps(v, _mm_mul_ps(accel, vdt));
+
+    //Friction takes speed towards zero but never past it
+    vf = _mm_sub_ps(vf, clampAbs(vf, _mm_mul_ps(_mm_mul_ps(vfriction, normal), vdt)));
+
+    //Brakes and launches, then holds
+    __m128 vp = _mm_add_ps(vf, _mm_mul_ps(push, vdt));
+    vp = _mm_min_ps(_mm_max_ps(vp, _mm_min_ps(vf, lo)), _mm_max_ps(vf, hi));
+    v = _mm_add_ps(vp, _mm_mul_ps(hold, _mm_sub_ps(lo, vp)));
+
+    //Position with the new speed, wrapped onto the track either way
+    s = _mm_add_ps(s, _mm_mul_ps(v, vdt));
+    __m128 over = _mm_cmpge_ps(s, vlength);
+    __m128 under = _mm_cmplt_ps(s, zero);
+    s = _mm_sub_ps(s, _mm_and_ps(over, vlength));
+    s = _mm_add_ps(s, _mm_and_ps(under, vlength));
+
+    //The masks are -1 in lanes that wrapped
+    __m128i laps = _mm_loadu_si128((const __m128i*)&lapCount[i]);
+    laps = _mm_sub_epi32(laps, _mm_castps_si128(over));
+    laps = _mm_add_epi32(laps, _mm_castps_si128(under));
+
+    _mm_storeu_ps(&position[i], s);
+    _mm_storeu_ps(&speed[i], v);
+    _mm_storeu_si128((__m128i*)&lapCount[i], laps);
+  }
+}
+
+#else
+
+void TrainPhysics::step(float dt)
+{
+  const int last = table.size() - 1;
+  for (int i = 0; i < count; i++)
+  {
+    float s = position[i];
+    float v = speed[i];
+    const Sample& row = table[std::min(std::max((int)(s * invSpacing + 0.5f), 0), last)];
+
+    float v2 = v * v;
+    float normal = sqrt(std::max(v2 * v2 * row.curvature2 + 2.f * v2 * row.curvGravity + row.gravity2, 0.f));
+    float vf = v + (row.slope - drag * v * fabs(v)) * dt;
+    float limit = friction * normal * dt;
+    vf -= std::min(std::max(vf, -limit), limit);
+
+    float vp = std::min(std::max(vf + row.push * dt, std::min(vf, row.lo)), std::max(vf, row.hi));
+    v = vp + row.hold * (row.lo - vp);
+
+    s += v * dt;
+    if (s >= totalLength)
+    {
+      s -= totalLength;
+      lapCount[i]++;
+    } else if (s < 0.f)
+    {
+      s += totalLength;
+      lapCount[i]--;
+    }
+    position[i] = s;
+    speed[i] = v;
+  }
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef TRAINPHYSICS_H
+#define TRAINPHYSICS_H
+
+#include "glm/glm.hpp"
+#include <vector>
+
+#include "tracksegments.h"
+#include "velocityprofile.h"
+
+using namespace glm;
+
+//Trains handled together by one pass of the SIMD integrator
+const int PHYSICS_LANES = 4;
+
+//Trains whose speed is integrated from the forces on them rather than
+//looked up from the energy model: gravity along the slope, rolling
+//friction against the normal force (gravity plus v^2 times curvature) and
+//aerodynamic drag. Lifts and stations hold a train at their speed, brakes
+//and launches push it towards theirs. Each step is semi-implicit Euler,
+//the speed first and then the position with the new speed.
+//
+//The slope, curvature and segment of the track are tabulated at even arc
+//length steps, so a train's row is found by one multiply. Train state is
+//kept in parallel arrays and stepped PHYSICS_LANES trains at a time with
+//SSE, falling back to plain C++ where SSE is not available.
+class TrainPhysics {
+public:
+  TrainPhysics(const std::vector<vec3>& points, const TrackSegments& segments,
+               const RideParameters& params = RideParameters());
+
+  //Puts a train at arc length s moving at v m/s and returns its index
+  int addTrain(float s, float v);
+
+  //Advances every train by one fixed simulation step of dt seconds
+  void step(float dt);
+
+  int numTrains() const { return count; }
+  float trackLength() const { return totalLength; }
+
+  //Arc length in [0, track length), speed along the track (negative when
+  //rolling back) and laps completed
+  float arcLength(int train) const { return position[train]; }
+  float velocity(int train) const { return speed[train]; }
+  int laps(int train) const { return lapCount[train]; }
+
+private:
+  //One table row, split into the halves the SIMD step transposes
+  struct Sample {
+    float slope;          //acceleration along the track from gravity
+    float curvature2;     //|dT/ds|^2
+    float curvGravity;    //dT/ds . gravity
+    float gravity2;       //|gravity across the track|^2
+    float push;           //brake (negative) or launch acceleration
+    float lo;             //brakes stop at this speed, and holds keep it
+    float hi;             //launches stop at this speed
+    float hold;           //1 on lifts and stations
+  };
+
+  std::vector<Sample> table;    //one extra row at the end, a copy of the first
+  float totalLength;
+  float spacing;
+  float invSpacing;
+  float friction;
+  float drag;                   //drag acceleration is drag * v * |v|
+
+  //per train, padded to a multiple of PHYSICS_LANES
+  int count;
+  std::vector<float> position;
+  std::vector<float> speed;
+  std::vector<int> lapCount;
+};
+
+#endif
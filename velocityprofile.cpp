@@ -0,0 +1,162 @@
+#include "velocityprofile.h"
+
+#include "track.h"
+
+#include <algorithm>
+#include <cmath>
+
+//Floor on the tabulated speed so a cart can never stall on an entry
+const float MIN_PROFILE_VELOCITY = 0.05f;
+
+//Stage each segment type is reported as
+static const RideStage SEGMENT_STAGE[SEGMENT_TYPE_COUNT] = {
+  STAGE_LIFTING,        //station
+  STAGE_LIFTING,        //lift
+  STAGE_FREE_FALL,      //free run
+  STAGE_DECELERATION,   //brake
+  STAGE_LIFTING         //launch
+};
+
+VelocityProfile::VelocityProfile(const std::vector<vec3>& points, int start,
+                                 const RideParameters& params):
+  VelocityProfile(points, TrackSegments(points, start), params)
+{
+}
+
+VelocityProfile::VelocityProfile(const std::vector<vec3>& points, const TrackSegments& track_segments,
+                                 const RideParameters& params):
+  index(points), segments(track_segments), stopAt(-1.f), stopIn(STAGE_COUNT)
+{
+  int size = points.size();
+  int start = segments.start();
+
+  velocity.resize(size);
+  stage.resize(size);
+
+  //Walk one lap from the start, switching rules whenever the segment
+  //changes. v2 carries the speed from one segment into the next, starting
+  //with the exit speed of the segment before the start.
+  const TrackSegment& before = segments.at((start + size - 1) % size);
+  double v2 = (double)before.speed * before.speed;
+  double entry = 0.0;
+  double crest = 0.0;
+  double base = 0.0;
+  int current = -1;
+  SegmentType previous = before.type;
+  bool boosted = false;
+
+  //v^2 lost to friction and drag since the crest, and how far the cart
+  //is into the current segment
+  double loss = 0.0;
+  double into = 0.0;
+  double g = length(GRAVITY);
+  double drag = (params.mass > 0.f) ? 0.5 * AIR_DENSITY * params.dragArea / params.mass : 0.0;
+
+  for (int n = 0; n < size; n++)
+  {
+    int k = (start + n) % size;
+    vec3 p = points.at(k);
+    const TrackSegment& seg = segments.at(k);
+
+    if (segments.segmentIndex(k) != current)
+    {
+      current = segments.segmentIndex(k);
+      into = 0.0;
+      entry = v2;
+      if (seg.type == SEGMENT_FREE_RUN)
+      {
+        //Over the top of a lift the cart gets the boost, anywhere else it
+        //keeps the speed it came in with
+        crest = p.y;
+        boosted = (previous == SEGMENT_LIFT);
+        base = boosted ? params.boost : v2;
+        loss = 0.0;
+      } else if (seg.type == SEGMENT_BRAKE && previous == SEGMENT_FREE_RUN && boosted)
+      {
+        entry = std::max(v2 + params.brakeBoost - params.boost, 0.0);
+      }
+      previous = seg.type;
+    }
+
+    float ds = ((k + 1 < size) ? index.sampleArcLength(k + 1) : index.trackLength()) - index.sampleArcLength(k);
+
+    double v;
+    switch (seg.type)
+    {
+    case SEGMENT_FREE_RUN:
+      v2 = g * (crest - p.y) * 2.0 + base - loss;
+      v = sqrt(std::max(v2, 0.0));
+      loss += 2.0 * (params.friction * g + drag * std::max(v2, 0.0)) * ds;
+      break;
+    case SEGMENT_BRAKE:
+      if (params.brakeDeceleration > 0.f)
+        v = sqrt(std::max(entry - 2.0 * params.brakeDeceleration * into, 0.0));
+      else
+        v = mix(sqrt(entry), (double)seg.speed, (seg.length > 0.f) ? into / seg.length : 1.0);
+      break;
+    case SEGMENT_LAUNCH:
+      v = sqrt(mix(entry, (double)seg.speed * seg.speed, (seg.length > 0.f) ? into / seg.length : 1.0));
+      break;
+    default:
+      v = seg.speed;
+      break;
+    }
+    if (seg.type != SEGMENT_FREE_RUN)
+      v2 = v * v;
+    into += ds;
+
+    stage[k] = SEGMENT_STAGE[seg.type];
+    if (v <= 0.0 && stopIn == STAGE_COUNT)
+    {
+      stopAt = index.sampleArcLength(k);
+      stopIn = (RideStage)stage[k];
+    }
+    velocity[k] = std::max((float)v, MIN_PROFILE_VELOCITY);
+  }
+
+  //Integrate dt = ds / v over every segment, averaging 1/v at both ends
+  for (int s = 0; s < STAGE_COUNT; s++)
+  {
+    dwell[s] = 0.f;
+  }
+  for (int t = 0; t < SEGMENT_TYPE_COUNT; t++)
+  {
+    segmentDwell[t] = 0.f;
+  }
+  for (int k = 0; k < size; k++)
+  {
+    float ds = ((k + 1 < size) ? index.sampleArcLength(k + 1) : index.trackLength()) - index.sampleArcLength(k);
+    float dt = 0.5f * ds * (1.f / velocity[k] + 1.f / velocity[(k + 1) % size]);
+    dwell[stage[k]] += dt;
+    segmentDwell[segments.at(k).type] += dt;
+  }
+}
+
+float VelocityProfile::velocityAt(float s) const
+{
+  float t;
+  int k = index.sampleAt(s, &t);
+  return mix(velocity[k], velocity[(k + 1) % velocity.size()], t);
+}
+
+RideStage VelocityProfile::stageAt(float s) const
+{
+  float t;
+  return (RideStage)stage[index.sampleAt(s, &t)];
+}
+
+const TrackSegment& VelocityProfile::segmentAt(float s) const
+{
+  float t;
+  return segments.at(index.sampleAt(s, &t));
+}
+
+float VelocityProfile::lapTime() const
+{
+  float total = 0.f;
+  for (int s = 0; s < STAGE_COUNT; s++)
+  {
+    total += dwell[s];
+  }
+  return total;
+}
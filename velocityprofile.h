@@ -0,0 +1,81 @@
+#ifndef VELOCITYPROFILE_H
+#define VELOCITYPROFILE_H
+
+#include "glm/glm.hpp"
+#include <vector>
+
+#include "arclengthindex.h"
+#include "tracksegments.h"
+
+using namespace glm;
+
+//The phases of the ride described in the README
+enum RideStage {
+  STAGE_LIFTING = 0,
+  STAGE_FREE_FALL,
+  STAGE_DECELERATION,
+  STAGE_COUNT
+};
+
+//Physical constants of the ride. The defaults give the original model:
+//no friction or drag, v^2 = 2 g h + 2 in free fall and 2 g h + 1 entering
+//the brakes, which slow the cart linearly to the station speed.
+struct RideParameters {
+  float friction;           //rolling friction coefficient
+  float mass;               //kg, only matters with drag
+  float dragArea;           //drag coefficient times frontal area, m^2
+  float boost;              //v^2 the cart has on top of the energy it gained falling
+  float brakeBoost;         //the same for the speed entering the brakes
+  float brakeDeceleration;  //m/s^2, 0 for the linear ramp to the exit speed
+
+  RideParameters(): friction(0.f), mass(500.f), dragArea(0.f), boost(2.f), brakeBoost(1.f),
+                    brakeDeceleration(0.f) {}
+};
+
+//Speed of the cart as a function of arc length, built once from the
+//energy model so the main loop only has to look it up
+class VelocityProfile {
+public:
+  //points is the closed curve produced by generateCurve and segments says
+  //what each part of it does. The ride starts from segments.start().
+  VelocityProfile(const std::vector<vec3>& points, const TrackSegments& segments,
+                  const RideParameters& params = RideParameters());
+
+  //Segments worked out from the shape, with start as the crest
+  VelocityProfile(const std::vector<vec3>& points, int start,
+                  const RideParameters& params = RideParameters());
+
+  //s is wrapped onto the track, so it can keep growing lap after lap
+  float velocityAt(float s) const;
+  RideStage stageAt(float s) const;
+  const TrackSegment& segmentAt(float s) const;
+
+  const TrackSegments& trackSegments() const { return segments; }
+
+  //Arc length at points[i]
+  float sampleArcLength(int i) const { return index.sampleArcLength(i); }
+
+  //Time for one full lap, and how much of it is spent in each stage
+  float lapTime() const;
+  float dwellTime(RideStage stage) const { return dwell[stage]; }
+  float segmentTime(SegmentType type) const { return segmentDwell[type]; }
+
+  float trackLength() const { return index.trackLength(); }
+
+  //Where the cart first comes to rest, stalling in free fall or stopped by
+  //the brakes, or -1 if it makes it round to the lift
+  float stopArcLength() const { return stopAt; }
+  RideStage stopStage() const { return stopIn; }
+
+private:
+  ArcLengthIndex index;
+  TrackSegments segments;
+  std::vector<float> velocity;    //speed at each sample
+  std::vector<unsigned char> stage;
+  float dwell[STAGE_COUNT];
+  float segmentDwell[SEGMENT_TYPE_COUNT];
+  float stopAt;
+  RideStage stopIn;
+};
+
+#endif
@@ -11,8 +11,9 @@
 layout(location = 0) in vec3 VertexPosition;
 layout(location = 1) in vec3 VertexNormal;
 
-uniform mat4 perspectiveMatrix;
-uniform mat4 modelviewMatrix ;
+//Shared by every program, see shaderprogram.h
+layout(std140) uniform FrameBlock { mat4 viewProjectionMatrix; };
+layout(std140) uniform ObjectBlock { mat4 modelMatrix; };
 // output to be interpolated between vertices and passed to the fragment stage
 
 out vec3 FragNormal;
@@ -20,5 +21,5 @@ out vec3 FragNormal;
 void main()
 {
 	FragNormal = VertexNormal;
-	gl_Position = perspectiveMatrix*modelviewMatrix*vec4(VertexPosition, 1.0);
+	gl_Position = viewProjectionMatrix * modelMatrix * vec4(VertexPosition, 1.0);
 }